@@ -0,0 +1,64 @@
+#ifndef BUDGET_H
+#define BUDGET_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+/*The clock is only read once every BUDGET_CLOCK_PERIOD nodes, so that a
+  tick stays a couple of integer operations on the hot path.*/
+#define BUDGET_CLOCK_PERIOD 64
+
+/*Limits given to a search. A search calls budget_tick on each node and
+  gives up as soon as it returns true.*/
+typedef struct budget {
+  uint64_t nodes;                  /* number of nodes visited so far */
+  uint64_t max_nodes;              /* 0 means there is no node limit */
+  bool has_deadline;
+  struct timespec deadline;
+  bool exceeded;                   /* once true, stays true */
+  int cancelled;                   /* set by budget_cancel, only read and
+                                      written atomically */
+  struct budget *parent;           /* set by budget_fork, NULL otherwise */
+  uint64_t flushed;                /* nodes already added to the parent */
+  pthread_mutex_t lock;            /* protects a parent shared by children */
+} budget_t;
+
+/*Initialize a budget starting now.
+  A timeout_ms or a max_nodes of 0 means there is no such limit.*/
+void budget_init (budget_t *budget, long timeout_ms, uint64_t max_nodes);
+
+/*Start an initialized budget again from now, with new limits, to reuse it
+  for another search. A cancelled budget stays cancelled, so a batch of
+  searches sharing it can be stopped at once.*/
+void budget_restart (budget_t *budget, long timeout_ms, uint64_t max_nodes);
+
+/*Release a budget made by budget_init.*/
+void budget_free (budget_t *budget);
+
+/*Initialize a budget for one thread of a search sharing the parent limits.
+  The child gives its nodes to the parent every BUDGET_CLOCK_PERIOD nodes and
+  stops as soon as the parent is exceeded or cancelled. The parent can be a
+  child itself, and the child can be given its own max_nodes.*/
+void budget_fork (budget_t *child, budget_t *parent);
+
+/*Give the last nodes of the child to its parent and release the child.*/
+void budget_join (budget_t *child);
+
+/*Ask the search using this budget to stop as soon as possible.
+  It can be called from another thread or from a signal handler.*/
+void budget_cancel (budget_t *budget);
+
+/*Count one more node. Return true if the search must stop, because the
+  budget has been cancelled or one of its limits has been reached.*/
+bool budget_tick (budget_t *budget);
+
+/*Return true if budget_cancel has been called on the budget.*/
+bool budget_cancelled (const budget_t *budget);
+
+/*Return true if the budget has been exceeded or cancelled, or a budget
+  above it cancelled.*/
+bool budget_exceeded (const budget_t *budget);
+
+#endif
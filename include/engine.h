@@ -0,0 +1,149 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <budget.h>
+#include <preemptive_set.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <trace.h>
+
+/*Bitboards are used by default up to this size. Beyond, a board has too
+  many words and scanning the cells of the units is faster.*/
+#define ENGINE_BITBOARD_SIZE 36
+
+/*Results of engine_search.*/
+#define ENGINE_DONE 0     /* the whole search tree has been explored */
+#define ENGINE_LIMIT 1    /* stopped by the solution limit or the callback */
+#define ENGINE_STOPPED 2  /* stopped because the budget ran out */
+
+/*One choice of the search : the cell we branched on, the color tried and
+  the colors still to try. mark is the trail length before the choice.*/
+typedef struct {
+  int cell;
+  pset_t chosen;
+  pset_t remaining;
+  size_t mark;
+} frame_t;
+
+/*Search state over a flat grid (cell = line * size + row).
+  Every modification of a cell is recorded on the trail so that a
+  backtrack only undoes what has been changed since the choice, instead of
+  copying the whole grid at each node like grid_solver does.*/
+typedef struct engine {
+  int size;              /* number of colors, lines and rows */
+  int block;             /* square root of size */
+  int ncells;            /* size * size */
+  pset_t full;
+  pset_t *cells;
+
+  int *units;            /* the 3*size units (lines, rows, blocks) */
+  int *cell_units;       /* the 3 units of each cell */
+
+  /* digit-major view of cells, kept in sync when bitboards is true : one
+     bit per cell for each color, set if the color can go in the cell */
+  bool bitboards;
+  int words;             /* 64-bit words of a board */
+  uint64_t *boards;      /* size boards */
+  uint64_t *unit_masks;  /* the cells of each unit, as a board */
+  pset_t *dirty_colors;  /* colors to scan in each dirty unit */
+
+  int *trail_cell;       /* cell changed ... */
+  pset_t *trail_old;     /* ... and its value before the change */
+  size_t trail_len;
+  size_t trail_cap;
+
+  int *queue;            /* new singletons to remove from their units */
+  int queue_len;
+  bool *dirty;           /* units to scan for lone numbers */
+  int *dirty_list;
+  int dirty_len;
+
+  frame_t *stack;        /* the current branch of the search tree */
+  int depth;
+
+  uint64_t solutions;    /* solutions found by engine_search */
+  budget_t *budget;      /* NULL means no limit */
+  trace_t *trace;        /* NULL means no trace */
+  int rule;              /* what the changes come from, for the trace */
+
+  /* once set (by a signal handler for instance), on_checkpoint is called
+     at the next point where the search can be saved */
+  volatile sig_atomic_t checkpoint;
+  bool (*on_checkpoint) (struct engine *engine, void *data);
+  void *checkpoint_data;
+} engine_t;
+
+/*Function called on each solution found, the solution being in
+  engine->cells. Returning false stops the search.*/
+typedef bool (*engine_solution_fn) (engine_t *engine, void *data);
+
+/*Function called by engine_search when engine->checkpoint has been set,
+  between two nodes, where engine_save can write the search. Returning false
+  stops the search (ENGINE_STOPPED).*/
+typedef bool (*engine_checkpoint_fn) (engine_t *engine, void *data);
+
+/*Allocate an engine for size-sized grids. It uses bitboards if size is at
+  most ENGINE_BITBOARD_SIZE.*/
+engine_t *engine_new (int size);
+
+/*Choose whether the engine keeps the bitboards and propagates with them.
+  Must be called before engine_load.*/
+void engine_set_bitboards (engine_t *engine, bool bitboards);
+
+/*Release an engine.*/
+void engine_free (engine_t *engine);
+
+/*Load a flat grid of ncells psets into the engine and reset the search.
+  cells may be engine->cells itself, when the grid has been written there.*/
+void engine_load (engine_t *engine, const pset_t *cells);
+
+/*Restrict a cell to the colors of pset (recorded on the trail).
+  Return false if the cell becomes empty.*/
+bool engine_restrict (engine_t *engine, int cell, pset_t pset);
+
+/*Apply cross-hatching and lone number until nothing changes.
+  Return false if the grid isn't consistent.*/
+bool engine_propagate (engine_t *engine);
+
+/*Undo every change made after the trail had the length mark.*/
+void engine_undo (engine_t *engine, size_t mark);
+
+/*Forget the choices of the last search and undo every change made after the
+  trail had the length mark, so that another search can start from there.*/
+void engine_rewind (engine_t *engine, size_t mark);
+
+/*Explore the search tree from the current grid, depth-first, trying the
+  colors of the cell with the fewest choices from the leftmost one.
+  on_solution (which may be NULL) is called for each solution, and the
+  search stops after limit solutions (0 means no limit).
+  Return ENGINE_DONE, ENGINE_LIMIT or ENGINE_STOPPED.*/
+int engine_search (engine_t *engine, uint64_t limit,
+                   engine_solution_fn on_solution, void *data);
+
+/*Write in cells the grid the engine has been loaded with.*/
+void engine_root (const engine_t *engine, pset_t *cells);
+
+/*Write the search of the engine to file, in text : the grid it has been
+  loaded with, the choices of the current branch with the colors left to try
+  and the number of solutions found. Return false on a writing error.*/
+bool engine_save (const engine_t *engine, FILE *file);
+
+/*Read a search written by engine_save and return a new engine where
+  engine_search continues it exactly where it was, NULL if the file isn't
+  a valid search.*/
+engine_t *engine_resume (FILE *file);
+
+/*Same as engine_search, but the search tree is split between jobs threads,
+  each one with its own engine, using the bitboards or not (as chosen by
+  engine_set_bitboards). on_solution is never called by two threads at the
+  same time and the solutions may come in any order.
+  The number of solutions is written in *solutions.*/
+int engine_search_parallel (int size, const pset_t *cells, int jobs,
+                            bool bitboards, uint64_t limit,
+                            engine_solution_fn on_solution, void *data,
+                            budget_t *budget, uint64_t *solutions);
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef LANES_H
+#define LANES_H
+
+#include <stdint.h>
+
+/*Sizes of the grids which fit in a 16-bit lane.*/
+#define LANES_MAX_SIZE 16
+
+/*Status of a grid after lanes_propagate.*/
+#define LANES_SOLVED 0        /* solved by propagation alone */
+#define LANES_OPEN 1          /* a choice has to be made */
+#define LANES_INCONSISTENT 2  /* propagation found a contradiction */
+
+/*Return the number of grids propagated together by the best instruction
+  set of this processor (AVX-512, AVX2 or SSE2), chosen at run time.*/
+int lanes_width (void);
+
+/*Return the name of the instruction set used by lanes_propagate.*/
+const char *lanes_target (void);
+
+/*Apply cross-hatching and lone number to count independent grids of size 9
+  or 16 at once, one grid per SIMD lane, until none of them changes.
+  grids holds the count grids one after the other, each one as size*size
+  candidate sets where bit i is the color i. The grids are reduced in place
+  and the status of grid k is written in status[k].*/
+void lanes_propagate (int size, int count, uint16_t *grids, int *status);
+
+#endif
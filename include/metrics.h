@@ -0,0 +1,60 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*Latencies are counted in log-linear buckets : each power of two of
+  nanoseconds is split into METRICS_SUB_BUCKETS buckets, so a latency is
+  known within 1/16 (6%) whatever its magnitude, from 1 ns to hours.*/
+#define METRICS_SUB_BITS 4
+#define METRICS_SUB_BUCKETS (1 << METRICS_SUB_BITS)
+#define METRICS_BUCKETS (METRICS_SUB_BUCKETS * 41)
+
+/*Grids up to 256x256 : one set of histograms per block size.*/
+#define METRICS_MAX_BLOCK 16
+
+/*Written every METRICS_INTERVAL_MS milliseconds by default.*/
+#define METRICS_INTERVAL_MS 1000
+
+/*Result classes of a grid.*/
+#define METRICS_UNIQUE 0
+#define METRICS_MULTIPLE 1
+#define METRICS_INCONSISTENT 2
+#define METRICS_UNKNOWN 3       /* the budget ran out, or nothing checked */
+#define METRICS_RESULTS 4
+
+typedef struct metrics metrics_t;
+
+/*The part of the metrics written by one thread. Only this thread records in
+  it, so recording takes no lock and doesn't wait for the other threads.*/
+typedef struct metrics_shard metrics_shard_t;
+
+/*Allocate metrics for shards threads and start the clock. If path isn't
+  NULL, the metrics are written in the file path in the Prometheus text
+  format every interval_ms milliseconds by a thread of their own.*/
+metrics_t *metrics_new (int shards, const char *path, long interval_ms);
+
+/*Return the shard k, to be used by one thread only.*/
+metrics_shard_t *metrics_shard (metrics_t *metrics, int k);
+
+/*Record a grid of size colors with its result class, the time it took in
+  nanoseconds and the number of search nodes.*/
+void metrics_record (metrics_shard_t *shard, int size, int result,
+                     uint64_t latency_ns, uint64_t nodes);
+
+/*Write the metrics in the Prometheus text format.*/
+void metrics_write (metrics_t *metrics, FILE *file);
+
+/*Write a summary for humans : throughput, peak memory and latency
+  percentiles for each size and result.*/
+void metrics_summary (metrics_t *metrics, FILE *file);
+
+/*Stop the writing thread, write the file one last time and release the
+  metrics.*/
+void metrics_free (metrics_t *metrics);
+
+/*Return the time of the monotonic clock in nanoseconds.*/
+uint64_t metrics_now (void);
+
+#endif
@@ -5,10 +5,30 @@
 #include <stdint.h>
 #include <unistd.h>
 
-#define MAX_COLORS 64
+/*Number of 64-bit words of a pset, fixed at compile time : 1 for grids up
+  to 64x64, 2 up to 128x128 and 4 up to 256x256 (make PSET_WORDS=4).
+  Beyond one word, a pset is a GCC vector so that AND, OR, XOR and NOT work
+  on every word at once.*/
+#ifndef PSET_WORDS
+#define PSET_WORDS 1
+#endif
+
+#define MAX_COLORS (64 * PSET_WORDS)
 #define FULL UINT64_MAX /* thank you Edon */
 
+#if PSET_WORDS == 1
 typedef uint64_t pset_t;
+#elif PSET_WORDS == 2 || PSET_WORDS == 4
+/* aligned as a uint64_t, since psets are allocated with malloc */
+typedef uint64_t pset_t __attribute__ ((vector_size (8 * PSET_WORDS),
+                                        aligned (8)));
+#else
+#error "PSET_WORDS must be 1, 2 or 4"
+#endif
+
+/*Number of colors which have a character (the others are only written as
+  numbers).*/
+#define CHAR_COLORS 64
 
 /*Convert a char into pset_t.
   If the char isn't a known color, it returns 0.*/
@@ -16,7 +36,7 @@ pset_t char2pset (char c);
 
 /*Convert a pset into string.
   Assuming that the memory zone given as argument has enough space to handle
-  the full string.*/
+  the full string. Only the first CHAR_COLORS colors are written.*/
 void pset2str (char string[MAX_COLORS + 1], pset_t pset);
 
 /*Return the pset full corresponding to the maximum of the color range
@@ -51,6 +71,12 @@ pset_t pset_xor (pset_t pset1, pset_t pset2);
 /*Tests if pset1 is included IN pset2.*/
 bool pset_is_included (pset_t pset1, pset_t pset2);
 
+/*Test if pset is the empty set.*/
+bool pset_is_empty (pset_t pset);
+
+/*Test if the two psets have the same colors.*/
+bool pset_equal (pset_t pset1, pset_t pset2);
+
 /*Test if pset is a singleton.*/
 bool pset_is_singleton (pset_t pset);
 
@@ -61,4 +87,17 @@ size_t pset_cardinality (pset_t pset);
 /*return the left most color of a set. */
 pset_t pset_leftmost (pset_t pset);
 
+/*Return the position in the color range of the left most color of a set,
+  -1 if the set is empty.*/
+int pset_index (pset_t pset);
+
+/*Return the singleton of the color at position index in the color range.*/
+pset_t pset_from_index (int index);
+
+/*Return the first 64 colors of pset, as the bits of an integer.*/
+uint64_t pset_first_word (pset_t pset);
+
+/*Return the pset of the first 64 colors given by the bits of word.*/
+pset_t pset_from_first_word (uint64_t word);
+
 #endif
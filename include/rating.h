@@ -0,0 +1,65 @@
+#ifndef RATING_H
+#define RATING_H
+
+#include <budget.h>
+#include <engine.h>
+#include <preemptive_set.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*Techniques, from the cheapest one. A grid is solved by the cheapest
+  technique which makes progress, and branching is only used when none of
+  them does.*/
+#define RATING_NAKED_SINGLE 0      /* a cell has one color left */
+#define RATING_HIDDEN_SINGLE 1     /* a color has one cell left in a unit */
+#define RATING_LOCKED_CANDIDATES 2 /* the cells of a color in a unit are all
+                                      in another unit */
+#define RATING_NAKED_PAIR 3        /* two cells of a unit have the same two
+                                      colors */
+#define RATING_BRANCHING 4
+#define RATING_TECHNIQUES 5
+
+/*No grade is too high.*/
+#define RATING_NO_CEILING 1e9
+
+/*The rating of a grid. The grade is the weight of the hardest technique
+  used (1 for naked singles up to 4 for branching), plus log2 of the nodes
+  of the search when branching has been needed.*/
+typedef struct grade {
+  double grade;
+  int hardest;                        /* -1 if the grid was already solved */
+  uint64_t uses[RATING_TECHNIQUES];   /* cells solved or changed by each */
+  uint64_t nodes;                     /* nodes of the search, if any */
+  uint64_t solutions;                 /* 0, 1 or 2 (at least 2) */
+} grade_t;
+
+/*The buffers needed to rate size-sized grids, allocated once and reused
+  from one grid to the next (a generator rates a grid after each clue it
+  removes). No deduction is kept : each rating starts again from its grid.*/
+typedef struct rating {
+  engine_t *engine;  /* its units, and the branching */
+  budget_t *parent;  /* the budget the branching counts its nodes in */
+  budget_t budget;   /* forked from parent for each branching */
+  pset_t *cells;
+  bool *placed;      /* singletons already removed from their units */
+  bool *given;
+} rating_t;
+
+/*Allocate what is needed to rate size-sized grids. The branching is
+  stopped by the limits of parent, and its nodes are counted there.*/
+rating_t *rating_new (int size, budget_t *parent);
+
+/*Release a rating.*/
+void rating_free (rating_t *rating);
+
+/*Rate the grid cells (size*size sets, line after line). The rating stops
+  as soon as the grade would be above ceiling, or when the parent budget is
+  exceeded : false is returned then, and grade only holds what was found so
+  far. grade->solutions tells whether the grid has one solution.*/
+bool rating_rate (rating_t *rating, const pset_t *cells, double ceiling,
+                  grade_t *grade);
+
+/*Name of a technique.*/
+const char *rating_technique_name (int technique);
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+/*Pseudo-random generator (xorshift64*) with its own state, so that each
+  thread can have its own reproducible stream instead of sharing rand().*/
+typedef struct {
+  uint64_t state;
+} rng_t;
+
+/*Seed the generator. Two different streams with the same seed give
+  independent sequences.*/
+void rng_seed (rng_t *rng, uint64_t seed, uint64_t stream);
+
+/*Return the next 64 random bits.*/
+uint64_t rng_next (rng_t *rng);
+
+/*Return a random integer between 0 and bound - 1.*/
+int rng_below (rng_t *rng, int bound);
+
+#endif
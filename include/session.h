@@ -0,0 +1,87 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <budget.h>
+#include <engine.h>
+#include <preemptive_set.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*An edit of a session : the given of cell before and after it (an empty
+  set for no given).*/
+typedef struct session_edit {
+  int cell;
+  pset_t before;
+  pset_t after;
+} session_edit_t;
+
+/*A grid edited one given at a time, for interactive use. The engine keeps
+  the propagated grid : placing a given only propagates what it changes.
+  Removing one is a rewind and replay, since the trail doesn't tell which
+  given a deduction came from : the trail is undone back to where the given
+  was placed, which also undoes the givens placed after it, then these are
+  placed and propagated again. Removing the last given placed only undoes
+  its own changes, an early one costs as much as placing the later ones.*/
+typedef struct session {
+  engine_t *engine;
+  bool base_consistent; /* the grid loaded, without its givens */
+
+  /* the givens in the order they have been placed */
+  int *given_cell;
+  pset_t *given_color;
+  size_t *given_mark;   /* trail length before the given */
+  int givens;
+  int *given_at;        /* index of the given of each cell, -1 if none */
+  int propagated;       /* givens placed before the first contradiction */
+
+  int solutions;        /* 0, 1 or 2 (at least 2), -1 until searched */
+  pset_t *solution;     /* the first solution found */
+
+  session_edit_t *edits;/* the places and removals, to undo them */
+  int nedits;
+  int edits_size;
+} session_t;
+
+/*Allocate a session for size-sized grids, with an empty grid. Its
+  searches are stopped by budget.*/
+session_t *session_new (int size, budget_t *budget);
+
+/*Release a session.*/
+void session_free (session_t *session);
+
+/*Start again from the grid cells (size*size sets, line after line) : its
+  singletons become givens, which can be removed, the other cells are kept
+  as they are. There is no edit to undo then. Return false if the grid
+  isn't consistent.*/
+bool session_load (session_t *session, const pset_t *cells);
+
+/*Place the given color (from 0) in cell, replacing the given it may have.
+  Return false if the grid isn't consistent anymore.*/
+bool session_place (session_t *session, int cell, int color);
+
+/*Remove the given of cell. Return false if the cell has no given.*/
+bool session_remove (session_t *session, int cell);
+
+/*Undo the last place or removal not undone yet. Return false if there is
+  none.*/
+bool session_undo (session_t *session);
+
+/*Return true if no contradiction has been found by the propagation.*/
+bool session_consistent (const session_t *session);
+
+/*Return the number of solutions, up to 2 (2 meaning at least 2), or -1 if
+  the budget stopped the search. It is only searched again after the grid
+  has changed.*/
+int session_solutions (session_t *session);
+
+/*Choose the next cell to hint and its color : the first cell which isn't a
+  given and whose color is forced by the propagation (*forced is then true),
+  or else the cell with the fewest colors left, with its color in the first
+  solution. Return the cell, -1 if the grid has no solution, no cell is
+  left, or the budget stopped the search.*/
+int session_hint (session_t *session, int *color, bool *forced);
+
+/*Return the propagated grid (size*size sets).*/
+const pset_t *session_cells (const session_t *session);
+
+#endif
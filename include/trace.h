@@ -0,0 +1,109 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <preemptive_set.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*Events kept in memory : 64K events of 16 bytes (1 MiB). When the writing
+  thread is late by that many events, the new ones are dropped (and
+  counted) rather than slowing the search down.*/
+#define TRACE_RING_EVENTS (1 << 16)
+
+#define TRACE_MAGIC "SDKTRACE"
+#define TRACE_VERSION 1
+
+/*Kinds of event.*/
+#define TRACE_GRID 0          /* a new grid of left colors */
+#define TRACE_BRANCH 1        /* color tried in cell, left colors to try */
+#define TRACE_ASSIGN 2        /* cell reduced to color by rule */
+#define TRACE_ELIMINATE 3     /* color removed from cell by rule */
+#define TRACE_CONTRADICTION 4 /* cell emptied (or a unit, cell being -1) */
+#define TRACE_BACKTRACK 5     /* the choice made in cell is undone */
+#define TRACE_SOLUTION 6      /* a solution has been found */
+#define TRACE_CLUE_REMOVED 7  /* generation : the clue color of cell goes */
+#define TRACE_CLUE_KEPT 8     /* generation : it has to stay */
+#define TRACE_KINDS 9
+
+/*Rules making the changes.*/
+#define TRACE_NO_RULE 0
+#define TRACE_GIVEN 1         /* the grid itself, or its clues */
+#define TRACE_CHOICE 2        /* a branch of the search */
+#define TRACE_CROSS_HATCHING 3
+#define TRACE_LONE_NUMBER 4
+#define TRACE_RULES 5
+
+/*An event as written in the trace file, after the header. depth is the
+  number of choices above the event, node the low 32 bits of the number of
+  nodes searched (the decoder unwraps it), cell is line * size + row.*/
+typedef struct trace_event {
+  uint32_t node;
+  int32_t cell;     /* -1 : no cell */
+  uint16_t depth;
+  uint8_t kind;
+  uint8_t rule;
+  int16_t color;    /* from 0, -1 : no color */
+  uint16_t left;    /* colors left in the cell */
+} trace_event_t;
+
+/*The first bytes of the trace file, written again when it is closed.*/
+typedef struct trace_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t event_size;
+  uint64_t events;  /* events written */
+  uint64_t dropped; /* events lost because the ring was full */
+  uint64_t nodes;
+} trace_header_t;
+
+/*A trace is written by one search thread. Its events go in a ring which
+  another thread writes to the file, so the search never waits for it.*/
+typedef struct trace {
+  FILE *file;
+  trace_event_t *ring;
+  uint64_t head;          /* events put in the ring, by the search */
+  uint64_t tail;          /* events written, by the writing thread */
+  uint64_t dropped;
+  bool failed;            /* a write went wrong */
+  bool stop;
+  pthread_t writer;
+
+  uint64_t nodes;
+  uint64_t sample;        /* 1 node in sample is traced */
+  uint64_t countdown;     /* nodes before the next traced one */
+  bool sampled;           /* the events of this node are traced */
+  int depth;              /* choices made, for searches without a stack */
+} trace_t;
+
+/*True if the current node is traced : events are only built then, so that
+  a search which isn't traced only tests a pointer.*/
+#define TRACE_ON(trace) ((trace) != NULL && (trace)->sampled)
+
+/*Create the file path and start its writing thread. One node in sample
+  (at least 1) is traced with all its events. Return NULL if the file
+  can't be created.*/
+trace_t *trace_new (const char *path, uint64_t sample);
+
+/*Count a new node of the search and decide if it is traced.*/
+void trace_node (trace_t *trace);
+
+/*Add an event to the ring, or count it as dropped if the ring is full.*/
+void trace_event (trace_t *trace, int kind, int rule, int depth, int cell,
+                  int color, int left);
+
+/*Trace the change of cell from the colors old to the colors new by rule :
+  an assignment, an elimination or a contradiction.*/
+void trace_change (trace_t *trace, int rule, int depth, int cell,
+                   pset_t old, pset_t new);
+
+/*Write the last events, complete the header and close the file.
+  Return false if the file couldn't be written.*/
+bool trace_free (trace_t *trace);
+
+/*Names of the kinds and rules, for the decoder.*/
+const char *trace_kind_name (int kind);
+const char *trace_rule_name (int rule);
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include <preemptive_set.h>
+#include <stdbool.h>
+
+/*Kinds of violation, in the order they are looked for.*/
+#define VERIFY_OK 0
+#define VERIFY_CELL 1     /* a cell hasn't exactly one color */
+#define VERIFY_GIVEN 2    /* a cell hasn't the color given by the puzzle */
+#define VERIFY_LINE 3     /* a color is twice in a line */
+#define VERIFY_ROW 4      /* a color is twice in a row */
+#define VERIFY_BLOCK 5    /* a color is twice in a block */
+
+/*The first violation found in a grid.*/
+typedef struct verify_error {
+  int kind;
+  int unit;     /* line, row or block number (from 0) */
+  int cell;     /* the cell at fault, line * size + row */
+  pset_t color; /* the color repeated, or the one given */
+} verify_error_t;
+
+/*Return true if cells (size*size sets, line after line) is a solved grid
+  of size colors : one color by cell, all different in each line, row and
+  block. If givens isn't NULL, the cells must also be included in the
+  givens of the puzzle. Otherwise the first violation is written in error.*/
+bool verify_grid (int size, const pset_t *cells, const pset_t *givens,
+                  verify_error_t *error);
+
+#endif
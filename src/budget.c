@@ -0,0 +1,144 @@
+#include <budget.h>
+
+/* cancelled is written by signal handlers and other threads */
+#define LOAD(x) __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+#define STORE(x, value) __atomic_store_n(&(x), (value), __ATOMIC_RELEASE)
+
+static bool deadline_passed (const struct timespec *deadline)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec > deadline->tv_sec ||
+          (now.tv_sec == deadline->tv_sec && now.tv_nsec >= deadline->tv_nsec));
+}
+
+
+void budget_init (budget_t *budget, long timeout_ms, uint64_t max_nodes)
+{
+  budget->parent = NULL;
+  STORE(budget->cancelled, 0);
+  pthread_mutex_init(&budget->lock, NULL);
+  budget_restart(budget, timeout_ms, max_nodes);
+}
+
+
+void budget_restart (budget_t *budget, long timeout_ms, uint64_t max_nodes)
+{
+  budget->nodes = 0;
+  budget->max_nodes = max_nodes;
+  budget->exceeded = false;
+  budget->has_deadline = (timeout_ms > 0);
+  budget->flushed = 0;
+
+  if (budget->has_deadline) {
+    clock_gettime(CLOCK_MONOTONIC, &budget->deadline);
+    budget->deadline.tv_sec += timeout_ms / 1000;
+    budget->deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+    if (budget->deadline.tv_nsec >= 1000000000L) {
+      budget->deadline.tv_sec++;
+      budget->deadline.tv_nsec -= 1000000000L;
+    }
+  }
+}
+
+
+void budget_fork (budget_t *child, budget_t *parent)
+{
+  budget_init(child, 0, 0);
+  child->parent = parent;
+}
+
+
+/* add the nodes of the child to its parent, and check the parent limits
+   (up to the first budget, when the parent is itself a child) */
+static void budget_flush (budget_t *child)
+{
+  budget_t *parent = child->parent;
+
+  pthread_mutex_lock(&parent->lock);
+  parent->nodes += child->nodes - child->flushed;
+  child->flushed = child->nodes;
+  if (parent->parent != NULL) {
+    budget_flush(parent);
+  }
+  if (parent->max_nodes != 0 && parent->nodes > parent->max_nodes) {
+    parent->exceeded = true;
+  } else if (parent->has_deadline && deadline_passed(&parent->deadline)) {
+    parent->exceeded = true;
+  }
+  if (parent->exceeded) {
+    child->exceeded = true;
+  }
+  pthread_mutex_unlock(&parent->lock);
+}
+
+
+void budget_join (budget_t *child)
+{
+  budget_flush(child);
+  pthread_mutex_destroy(&child->lock);
+}
+
+
+void budget_free (budget_t *budget)
+{
+  pthread_mutex_destroy(&budget->lock);
+}
+
+
+void budget_cancel (budget_t *budget)
+{
+  STORE(budget->cancelled, 1);
+}
+
+
+bool budget_cancelled (const budget_t *budget)
+{
+  return LOAD(budget->cancelled);
+}
+
+
+/* true if a budget above this one has been cancelled */
+static bool parent_cancelled (const budget_t *budget)
+{
+  for (budget_t *parent = budget->parent; parent != NULL;
+       parent = parent->parent) {
+    if (LOAD(parent->cancelled)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+
+bool budget_tick (budget_t *budget)
+{
+  budget->nodes++;
+
+  if (LOAD(budget->cancelled)) {
+    budget->exceeded = true;
+  } else if (budget->max_nodes != 0 && budget->nodes > budget->max_nodes) {
+    budget->exceeded = true;
+  } else if (budget->parent != NULL) {
+    if (parent_cancelled(budget)) {
+      budget->exceeded = true;
+    } else if (budget->nodes % BUDGET_CLOCK_PERIOD == 0) {
+      budget_flush(budget);
+    }
+  } else if (budget->has_deadline &&
+             budget->nodes % BUDGET_CLOCK_PERIOD == 1 &&
+             deadline_passed(&budget->deadline)) {
+    /* the modulo is 1 rather than 0 so that the very first node already
+       reads the clock */
+    budget->exceeded = true;
+  }
+
+  return budget->exceeded;
+}
+
+
+bool budget_exceeded (const budget_t *budget)
+{
+  return (budget->exceeded || LOAD(budget->cancelled) ||
+          parent_cancelled(budget));
+}
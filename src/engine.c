@@ -0,0 +1,924 @@
+#include <engine.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __GNUC__
+#define popcount(word) __builtin_popcountll(word)
+#define lowest_bit(word) __builtin_ctzll(word)
+#else
+#define popcount(word) pset_cardinality(word)
+#define lowest_bit(word) pset_index(word)
+#endif
+
+/* number of subproblems given to each thread by engine_search_parallel */
+#define SUBPROBLEMS_PER_JOB 16
+
+static void *engine_alloc (size_t count, size_t size)
+{
+  void *res = calloc(count, size);
+  if (res == NULL) {
+    fprintf(stderr,"sudoku: error: out of memory.\n");
+    exit(EXIT_FAILURE);
+  }
+  return res;
+}
+
+
+engine_t *engine_new (int size)
+{
+  engine_t *engine = engine_alloc(1, sizeof(engine_t));
+
+  engine->size = size;
+  engine->block = 1;
+  while (engine->block * engine->block < size) {
+    engine->block++;
+  }
+  engine->ncells = size * size;
+  engine->full = pset_full(size);
+  engine->cells = engine_alloc(engine->ncells, sizeof(pset_t));
+  engine->units = engine_alloc(3 * engine->ncells, sizeof(int));
+  engine->cell_units = engine_alloc(3 * engine->ncells, sizeof(int));
+
+  /* units 0 to size-1 are the lines, then the rows, then the blocks */
+  for (int j = 0; j<size; j++) {
+    for (int i = 0; i<size; i++) {
+      int cell = j * size + i;
+      int block = (j / engine->block) * engine->block + i / engine->block;
+      int position = (j % engine->block) * engine->block + i % engine->block;
+
+      engine->units[j * size + i] = cell;
+      engine->units[(size + i) * size + j] = cell;
+      engine->units[(2 * size + block) * size + position] = cell;
+
+      engine->cell_units[3 * cell] = j;
+      engine->cell_units[3 * cell + 1] = size + i;
+      engine->cell_units[3 * cell + 2] = 2 * size + block;
+    }
+  }
+
+  engine->words = (engine->ncells + 63) / 64;
+  engine->boards = engine_alloc(size * engine->words, sizeof(uint64_t));
+  engine->unit_masks = engine_alloc(3 * size * engine->words, sizeof(uint64_t));
+  for (int unit = 0; unit<3 * size; unit++) {
+    uint64_t *mask = engine->unit_masks + unit * engine->words;
+    for (int i = 0; i<size; i++) {
+      int cell = engine->units[unit * size + i];
+      mask[cell / 64] |= (uint64_t)1 << (cell % 64);
+    }
+  }
+  engine->dirty_colors = engine_alloc(3 * size, sizeof(pset_t));
+  engine->bitboards = (size <= ENGINE_BITBOARD_SIZE);
+
+  engine->trail_cap = 4 * engine->ncells;
+  engine->trail_cell = engine_alloc(engine->trail_cap, sizeof(int));
+  engine->trail_old = engine_alloc(engine->trail_cap, sizeof(pset_t));
+  engine->queue = engine_alloc(engine->ncells, sizeof(int));
+  engine->dirty = engine_alloc(3 * size, sizeof(bool));
+  engine->dirty_list = engine_alloc(3 * size, sizeof(int));
+  engine->stack = engine_alloc(engine->ncells, sizeof(frame_t));
+  engine->budget = NULL;
+
+  return engine;
+}
+
+
+void engine_set_bitboards (engine_t *engine, bool bitboards)
+{
+  engine->bitboards = bitboards;
+}
+
+
+void engine_free (engine_t *engine)
+{
+  free(engine->cells);
+  free(engine->units);
+  free(engine->cell_units);
+  free(engine->boards);
+  free(engine->unit_masks);
+  free(engine->dirty_colors);
+  free(engine->trail_cell);
+  free(engine->trail_old);
+  free(engine->queue);
+  free(engine->dirty);
+  free(engine->dirty_list);
+  free(engine->stack);
+  free(engine);
+}
+
+
+/* colors are the colors which changed in the unit, only used with the
+   bitboards which scan a unit color by color */
+static void mark_dirty (engine_t *engine, int unit, pset_t colors)
+{
+  engine->dirty_colors[unit] = pset_or(engine->dirty_colors[unit], colors);
+  if (!engine->dirty[unit]) {
+    engine->dirty[unit] = true;
+    engine->dirty_list[engine->dirty_len] = unit;
+    engine->dirty_len++;
+  }
+}
+
+
+/* forget the pending propagation (after a contradiction or an undo) */
+static void clear_pending (engine_t *engine)
+{
+  engine->queue_len = 0;
+  for (int i = 0; i<engine->dirty_len; i++) {
+    engine->dirty[engine->dirty_list[i]] = false;
+    engine->dirty_colors[engine->dirty_list[i]] = pset_empty();
+  }
+  engine->dirty_len = 0;
+}
+
+
+/* set (in the bitboards) the bit of cell for each color of colors */
+static void board_set (engine_t *engine, int cell, pset_t colors)
+{
+  uint64_t bit = (uint64_t)1 << (cell % 64);
+  uint64_t *word = engine->boards + cell / 64;
+
+  while (!pset_is_empty(colors)) {
+    pset_t color = pset_leftmost(colors);
+    colors = pset_discard2(colors, color);
+    word[pset_index(color) * engine->words] |= bit;
+  }
+}
+
+
+/* clear (in the bitboards) the bit of cell for each color of colors */
+static void board_clear (engine_t *engine, int cell, pset_t colors)
+{
+  uint64_t bit = (uint64_t)1 << (cell % 64);
+  uint64_t *word = engine->boards + cell / 64;
+
+  while (!pset_is_empty(colors)) {
+    pset_t color = pset_leftmost(colors);
+    colors = pset_discard2(colors, color);
+    word[pset_index(color) * engine->words] &= ~bit;
+  }
+}
+
+
+void engine_load (engine_t *engine, const pset_t *cells)
+{
+  if (cells != engine->cells) {
+    memcpy(engine->cells, cells, engine->ncells * sizeof(pset_t));
+  }
+  engine->trail_len = 0;
+  engine->depth = 0;
+  engine->solutions = 0;
+  engine->rule = TRACE_GIVEN;
+  clear_pending(engine);
+
+  for (int cell = 0; cell<engine->ncells; cell++) {
+    if (pset_is_singleton(cells[cell])) {
+      engine->queue[engine->queue_len] = cell;
+      engine->queue_len++;
+    }
+  }
+  for (int unit = 0; unit<3 * engine->size; unit++) {
+    mark_dirty(engine, unit, engine->full);
+  }
+
+  if (engine->bitboards) {
+    memset(engine->boards, 0,
+           engine->size * engine->words * sizeof(uint64_t));
+    for (int cell = 0; cell<engine->ncells; cell++) {
+      board_set(engine, cell, engine->cells[cell]);
+    }
+  }
+}
+
+
+bool engine_restrict (engine_t *engine, int cell, pset_t pset)
+{
+  pset_t old = engine->cells[cell];
+  pset_t res = pset_and(old, pset);
+
+  if (pset_equal(res, old)) {
+    return true;
+  }
+
+  if (engine->trail_len == engine->trail_cap) {
+    engine->trail_cap *= 2;
+    engine->trail_cell = realloc(engine->trail_cell,
+                                 engine->trail_cap * sizeof(int));
+    engine->trail_old = realloc(engine->trail_old,
+                                engine->trail_cap * sizeof(pset_t));
+    if (engine->trail_cell == NULL || engine->trail_old == NULL) {
+      fprintf(stderr,"sudoku: error: out of memory.\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  engine->trail_cell[engine->trail_len] = cell;
+  engine->trail_old[engine->trail_len] = old;
+  engine->trail_len++;
+  engine->cells[cell] = res;
+  /* a choice is traced as a branch by next_choice */
+  if (TRACE_ON(engine->trace) && engine->rule != TRACE_CHOICE) {
+    trace_change(engine->trace, engine->rule, engine->depth, cell, old, res);
+  }
+  if (engine->bitboards) {
+    board_clear(engine, cell, pset_discard2(old, res));
+  }
+
+  if (pset_is_empty(res)) {
+    return false;
+  }
+  for (int k = 0; k<3; k++) {
+    mark_dirty(engine, engine->cell_units[3 * cell + k],
+               pset_discard2(old, res));
+  }
+  if (pset_is_singleton(res)) {
+    engine->queue[engine->queue_len] = cell;
+    engine->queue_len++;
+  }
+  return true;
+}
+
+
+/* cross-hatching : remove the color of a new singleton from its units */
+static bool remove_singleton (engine_t *engine, int cell)
+{
+  pset_t color = engine->cells[cell];
+  pset_t others = pset_negate(color);
+
+  for (int k = 0; k<3; k++) {
+    const int *unit = engine->units +
+                      engine->cell_units[3 * cell + k] * engine->size;
+    for (int i = 0; i<engine->size; i++) {
+      if (unit[i] != cell &&
+          !pset_is_empty(pset_and(engine->cells[unit[i]], color)) &&
+          !engine_restrict(engine, unit[i], others)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+
+/* same as remove_singleton with the bitboards : the cells to change are
+   the board of the color and the units of the cell, a few ANDs and ORs */
+static bool board_remove_singleton (engine_t *engine, int cell)
+{
+  int words = engine->words;
+  pset_t color = engine->cells[cell];
+  pset_t others = pset_negate(color);
+  const uint64_t *board = engine->boards + pset_index(color) * words;
+  const uint64_t *line = engine->unit_masks +
+                         engine->cell_units[3 * cell] * words;
+  const uint64_t *row = engine->unit_masks +
+                        engine->cell_units[3 * cell + 1] * words;
+  const uint64_t *block = engine->unit_masks +
+                          engine->cell_units[3 * cell + 2] * words;
+
+  for (int w = 0; w<words; w++) {
+    uint64_t hit = board[w] & (line[w] | row[w] | block[w]);
+    if (w == cell / 64) {
+      hit &= ~((uint64_t)1 << (cell % 64));
+    }
+    while (hit != 0) {
+      int other = w * 64 + lowest_bit(hit);
+      hit &= hit - 1;
+      if (!engine_restrict(engine, other, others)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+
+/* lone number : a color which can only go in one cell of the unit is placed
+   there. It also checks every color can still go somewhere in the unit. */
+static bool scan_unit (engine_t *engine, int u)
+{
+  const int *unit = engine->units + u * engine->size;
+  pset_t once = pset_empty();
+  pset_t twice = pset_empty();
+
+  for (int i = 0; i<engine->size; i++) {
+    twice = pset_or(twice, pset_and(once, engine->cells[unit[i]]));
+    once = pset_or(once, engine->cells[unit[i]]);
+  }
+  if (!pset_equal(once, engine->full)) {
+    if (TRACE_ON(engine->trace)) {
+      trace_event(engine->trace, TRACE_CONTRADICTION, TRACE_LONE_NUMBER,
+                  engine->depth, -1,
+                  pset_index(pset_discard2(engine->full, once)), 0);
+    }
+    return false;
+  }
+
+  pset_t lone = pset_discard2(once, twice);
+  if (pset_is_empty(lone)) {
+    return true;
+  }
+  for (int i = 0; i<engine->size; i++) {
+    pset_t found = pset_and(engine->cells[unit[i]], lone);
+    if (!pset_is_empty(found) &&
+        !pset_equal(found, engine->cells[unit[i]])) {
+      /* two lone colors in the same cell can't be both placed */
+      if (!pset_is_singleton(found) ||
+          !engine_restrict(engine, unit[i], found)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+
+/* same as scan_unit with the bitboards : for each color which changed in
+   the unit, the cells where it can go are the AND of its board and the unit
+   mask */
+static bool board_scan_unit (engine_t *engine, int unit, pset_t colors)
+{
+  int words = engine->words;
+  const uint64_t *mask = engine->unit_masks + unit * words;
+
+  while (!pset_is_empty(colors)) {
+    int color = pset_index(colors);
+    colors = pset_discard2(colors, pset_leftmost(colors));
+    const uint64_t *board = engine->boards + color * words;
+    int places = 0;
+    int cell = 0;
+
+    for (int w = 0; w<words; w++) {
+      uint64_t hit = board[w] & mask[w];
+      if (hit != 0) {
+        places += popcount(hit);
+        cell = w * 64 + lowest_bit(hit);
+      }
+    }
+
+    if (places == 0) {
+      if (TRACE_ON(engine->trace)) {
+        trace_event(engine->trace, TRACE_CONTRADICTION, TRACE_LONE_NUMBER,
+                    engine->depth, -1, color, 0);
+      }
+      return false;
+    }
+    if (places == 1 && !pset_is_singleton(engine->cells[cell]) &&
+        !engine_restrict(engine, cell, pset_from_index(color))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+bool engine_propagate (engine_t *engine)
+{
+  for (;;) {
+    engine->rule = TRACE_CROSS_HATCHING;
+    while (engine->queue_len > 0) {
+      engine->queue_len--;
+      int cell = engine->queue[engine->queue_len];
+      if (!(engine->bitboards ? board_remove_singleton(engine, cell)
+                              : remove_singleton(engine, cell))) {
+        clear_pending(engine);
+        engine->rule = TRACE_GIVEN;
+        return false;
+      }
+    }
+
+    if (engine->dirty_len == 0) {
+      engine->rule = TRACE_GIVEN;
+      return true;
+    }
+
+    engine->dirty_len--;
+    int unit = engine->dirty_list[engine->dirty_len];
+    pset_t colors = engine->dirty_colors[unit];
+    engine->dirty[unit] = false;
+    engine->dirty_colors[unit] = pset_empty();
+    engine->rule = TRACE_LONE_NUMBER;
+    if (!(engine->bitboards ? board_scan_unit(engine, unit, colors)
+                            : scan_unit(engine, unit))) {
+      clear_pending(engine);
+      engine->rule = TRACE_GIVEN;
+      return false;
+    }
+  }
+}
+
+
+void engine_undo (engine_t *engine, size_t mark)
+{
+  while (engine->trail_len > mark) {
+    engine->trail_len--;
+    int cell = engine->trail_cell[engine->trail_len];
+    pset_t old = engine->trail_old[engine->trail_len];
+    if (engine->bitboards) {
+      board_set(engine, cell, pset_discard2(old, engine->cells[cell]));
+    }
+    engine->cells[cell] = old;
+  }
+  clear_pending(engine);
+}
+
+
+void engine_rewind (engine_t *engine, size_t mark)
+{
+  engine->depth = 0;
+  engine->solutions = 0;
+  engine_undo(engine, mark);
+}
+
+
+/* return the first cell with the fewest choices, -1 if the grid is solved and
+   -2 if a cell is empty */
+static int choose_cell (const engine_t *engine)
+{
+  int chosen = -1;
+  size_t cardinality_chosen = MAX_COLORS + 1;
+
+  for (int cell = 0; cell<engine->ncells; cell++) {
+    if (!pset_is_singleton(engine->cells[cell])) {
+      size_t cardinality = pset_cardinality(engine->cells[cell]);
+      if (cardinality == 0) {
+        return -2;
+      }
+      if (cardinality < cardinality_chosen) {
+        chosen = cell;
+        cardinality_chosen = cardinality;
+      }
+    }
+  }
+  return chosen;
+}
+
+
+/* backtrack to the deepest choice with a color left to try, and try it.
+   return false once the whole tree has been explored. */
+static bool next_choice (engine_t *engine)
+{
+  while (engine->depth > 0) {
+    frame_t *frame = &engine->stack[engine->depth - 1];
+
+    engine_undo(engine, frame->mark);
+    if (TRACE_ON(engine->trace) && !pset_is_empty(frame->chosen)) {
+      trace_event(engine->trace, TRACE_BACKTRACK, TRACE_CHOICE,
+                  engine->depth, frame->cell, pset_index(frame->chosen),
+                  pset_cardinality(frame->remaining));
+    }
+    if (pset_is_empty(frame->remaining)) {
+      engine->depth--;
+    } else {
+      frame->chosen = pset_leftmost(frame->remaining);
+      frame->remaining = pset_discard2(frame->remaining, frame->chosen);
+      if (TRACE_ON(engine->trace)) {
+        trace_event(engine->trace, TRACE_BRANCH, TRACE_CHOICE, engine->depth,
+                    frame->cell, pset_index(frame->chosen),
+                    pset_cardinality(frame->remaining));
+      }
+      engine->rule = TRACE_CHOICE;
+      engine_restrict(engine, frame->cell, frame->chosen);
+      engine->rule = TRACE_GIVEN;
+      return true;
+    }
+  }
+  return false;
+}
+
+
+int engine_search (engine_t *engine, uint64_t limit,
+                   engine_solution_fn on_solution, void *data)
+{
+  bool consistent = engine_propagate(engine);
+
+  for (;;) {
+    if (engine->budget != NULL && budget_tick(engine->budget)) {
+      return ENGINE_STOPPED;
+    }
+    if (engine->trace != NULL) {
+      trace_node(engine->trace);
+    }
+
+    if (consistent) {
+      int cell = choose_cell(engine);
+
+      if (cell == -1) {
+        engine->solutions++;
+        if (TRACE_ON(engine->trace)) {
+          trace_event(engine->trace, TRACE_SOLUTION, TRACE_NO_RULE,
+                      engine->depth, -1, -1, 0);
+        }
+        if (on_solution != NULL && !on_solution(engine, data)) {
+          return ENGINE_LIMIT;
+        }
+        if (limit != 0 && engine->solutions >= limit) {
+          return ENGINE_LIMIT;
+        }
+      } else if (cell >= 0) {
+        frame_t *frame = &engine->stack[engine->depth];
+        frame->cell = cell;
+        frame->chosen = pset_empty();
+        frame->remaining = engine->cells[cell];
+        frame->mark = engine->trail_len;
+        engine->depth++;
+      }
+    }
+
+    if (!next_choice(engine)) {
+      return ENGINE_DONE;
+    }
+
+    /* the new choice isn't propagated yet : the search is only the grid
+       and the choices, which engine_resume replays */
+    if (engine->checkpoint && engine->on_checkpoint != NULL) {
+      engine->checkpoint = 0;
+      if (!engine->on_checkpoint(engine, engine->checkpoint_data)) {
+        return ENGINE_STOPPED;
+      }
+    }
+    consistent = engine_propagate(engine);
+  }
+}
+
+
+void engine_root (const engine_t *engine, pset_t *cells)
+{
+  memcpy(cells, engine->cells, engine->ncells * sizeof(pset_t));
+  for (size_t i = engine->trail_len; i>0; i--) {
+    cells[engine->trail_cell[i - 1]] = engine->trail_old[i - 1];
+  }
+}
+
+
+/* a set of colors is written as the numbers (from 1) of its colors separated
+   by commas, '_' for all the colors and '-' for none */
+static void pset_write (FILE *file, pset_t pset, pset_t full)
+{
+  const char *separator = "";
+
+  if (pset_equal(pset, full)) {
+    fprintf(file, "_");
+    return;
+  } else if (pset_is_empty(pset)) {
+    fprintf(file, "-");
+  }
+  while (!pset_is_empty(pset)) {
+    pset_t color = pset_leftmost(pset);
+    pset = pset_discard2(pset, color);
+    fprintf(file, "%s%d", separator, pset_index(color) + 1);
+    separator = ",";
+  }
+}
+
+
+static bool pset_read (FILE *file, int size, pset_t *pset)
+{
+  /* up to 256 colors of 3 digits and a comma */
+  char word[1026];
+  char *token = word;
+
+  if (fscanf(file, "%1025s", word) != 1) {
+    return false;
+  }
+  *pset = pset_empty();
+  if (strcmp(word, "_") == 0) {
+    *pset = pset_full(size);
+    return true;
+  } else if (strcmp(word, "-") == 0) {
+    return true;
+  }
+
+  while (*token != '\0') {
+    char *end;
+    long color = strtol(token, &end, 10);
+    if (end == token || color < 1 || color > size ||
+        (*end != ',' && *end != '\0')) {
+      return false;
+    }
+    *pset = pset_or(*pset, pset_from_index(color - 1));
+    token = (*end == ',') ? end + 1 : end;
+  }
+  return true;
+}
+
+
+bool engine_save (const engine_t *engine, FILE *file)
+{
+  pset_t *root = engine_alloc(engine->ncells, sizeof(pset_t));
+
+  engine_root(engine, root);
+  fprintf(file, "engine %d\nsolutions %llu\nroot\n", engine->size,
+          (unsigned long long) engine->solutions);
+  for (int cell = 0; cell<engine->ncells; cell++) {
+    pset_write(file, root[cell], engine->full);
+    fprintf(file, (cell % engine->size == engine->size - 1) ? "\n" : " ");
+  }
+  free(root);
+
+  fprintf(file, "depth %d\n", engine->depth);
+  for (int i = 0; i<engine->depth; i++) {
+    const frame_t *frame = &engine->stack[i];
+    fprintf(file, "%d %d ", frame->cell, pset_index(frame->chosen) + 1);
+    pset_write(file, frame->remaining, engine->full);
+    fprintf(file, "\n");
+  }
+  return !ferror(file);
+}
+
+
+engine_t *engine_resume (FILE *file)
+{
+  int size;
+  int depth;
+  unsigned long long solutions;
+
+  if (fscanf(file, " engine %d solutions %llu root", &size, &solutions) != 2 ||
+      size < 1 || size > MAX_COLORS) {
+    return NULL;
+  }
+  /* the units of engine_new only fit square sizes */
+  int block = 1;
+  while ((block + 1) * (block + 1) <= size) {
+    block++;
+  }
+  if (block * block != size) {
+    return NULL;
+  }
+
+  engine_t *engine = engine_new(size);
+  for (int cell = 0; cell<engine->ncells; cell++) {
+    if (!pset_read(file, size, &engine->cells[cell])) {
+      engine_free(engine);
+      return NULL;
+    }
+  }
+  engine_load(engine, engine->cells);
+
+  /* the choices are replayed as the search made them : every one of them
+     but the last has been propagated without contradiction */
+  if (fscanf(file, " depth %d", &depth) != 1 || depth < 0 ||
+      depth > engine->ncells || (depth > 0 && !engine_propagate(engine))) {
+    engine_free(engine);
+    return NULL;
+  }
+  for (int i = 0; i<depth; i++) {
+    frame_t *frame = &engine->stack[i];
+    int color;
+
+    if (fscanf(file, "%d %d", &frame->cell, &color) != 2 ||
+        frame->cell < 0 || frame->cell >= engine->ncells ||
+        color < 1 || color > size ||
+        !pset_read(file, size, &frame->remaining)) {
+      engine_free(engine);
+      return NULL;
+    }
+    frame->chosen = pset_from_index(color - 1);
+    frame->mark = engine->trail_len;
+    engine->depth = i + 1;
+    if (!engine_restrict(engine, frame->cell, frame->chosen) ||
+        (i < depth - 1 && !engine_propagate(engine))) {
+      engine_free(engine);
+      return NULL;
+    }
+  }
+
+  engine->solutions = solutions;
+  return engine;
+}
+
+
+/* state shared by the threads of engine_search_parallel */
+typedef struct {
+  int size;
+  bool bitboards;
+  pset_t *subproblems;
+  int nsubproblems;
+  int next;
+
+  pthread_mutex_t lock;
+  uint64_t solutions;
+  uint64_t limit;
+  bool limit_reached;
+  engine_solution_fn on_solution;
+  void *data;
+
+  int jobs;
+  budget_t *budgets;   /* one per thread */
+} shared_t;
+
+typedef struct {
+  pthread_t thread;
+  shared_t *shared;
+  int job;
+} job_t;
+
+
+/* stop every thread, the lock being held */
+static void stop_jobs (shared_t *shared)
+{
+  shared->limit_reached = true;
+  for (int i = 0; i<shared->jobs; i++) {
+    budget_cancel(&shared->budgets[i]);
+  }
+}
+
+
+static bool shared_solution (engine_t *engine, void *data)
+{
+  shared_t *shared = data;
+  bool go_on = true;
+
+  pthread_mutex_lock(&shared->lock);
+  if (shared->limit_reached) {
+    go_on = false;
+  } else {
+    shared->solutions++;
+    if (shared->on_solution != NULL) {
+      go_on = shared->on_solution(engine, shared->data);
+    }
+    if (shared->limit != 0 && shared->solutions >= shared->limit) {
+      go_on = false;
+    }
+    if (!go_on) {
+      stop_jobs(shared);
+    }
+  }
+  pthread_mutex_unlock(&shared->lock);
+
+  return go_on;
+}
+
+
+static void *job_main (void *data)
+{
+  job_t *job = data;
+  shared_t *shared = job->shared;
+  engine_t *engine = engine_new(shared->size);
+  engine_set_bitboards(engine, shared->bitboards);
+  /* without callback nor limit, solutions are only counted at the end */
+  bool counting_only = (shared->on_solution == NULL && shared->limit == 0);
+
+  engine->budget = &shared->budgets[job->job];
+  for (;;) {
+    pthread_mutex_lock(&shared->lock);
+    int subproblem = shared->next;
+    if (shared->limit_reached || subproblem == shared->nsubproblems) {
+      pthread_mutex_unlock(&shared->lock);
+      break;
+    }
+    shared->next++;
+    pthread_mutex_unlock(&shared->lock);
+
+    engine_load(engine, shared->subproblems + subproblem * engine->ncells);
+    int result = engine_search(engine, 0,
+                               counting_only ? NULL : shared_solution, shared);
+
+    if (counting_only) {
+      pthread_mutex_lock(&shared->lock);
+      shared->solutions += engine->solutions;
+      pthread_mutex_unlock(&shared->lock);
+    }
+    if (result != ENGINE_DONE) {
+      break;
+    }
+  }
+
+  engine_free(engine);
+  return NULL;
+}
+
+
+/* split the tree breadth-first until there are enough subproblems for the
+   threads. The solutions met on the way are given to shared_solution.
+   return false if the limit has been reached while splitting. */
+static bool split (engine_t *engine, shared_t *shared, int target)
+{
+  int ncells = engine->ncells;
+  int capacity = target + engine->size;
+  int first = 0;
+  int last = 0;
+  pset_t *pool = engine_alloc(capacity, ncells * sizeof(pset_t));
+
+  if (engine_propagate(engine)) {
+    memcpy(pool, engine->cells, ncells * sizeof(pset_t));
+    last = 1;
+  }
+
+  while (last > first && last - first < target) {
+    engine_load(engine, pool + first * ncells);
+    first++;
+    if (engine->budget != NULL && budget_tick(engine->budget)) {
+      break;
+    }
+
+    int cell = choose_cell(engine);
+    if (cell == -1) {
+      if (!shared_solution(engine, shared)) {
+        free(pool);
+        return false;
+      }
+      continue;
+    } else if (cell == -2) {
+      continue;
+    }
+
+    /* the pool is used as a queue : make room at its end */
+    if (last + engine->size > capacity) {
+      memmove(pool, pool + first * ncells, (last - first) * ncells * sizeof(pset_t));
+      last -= first;
+      first = 0;
+    }
+
+    pset_t colors = engine->cells[cell];
+    while (!pset_is_empty(colors)) {
+      pset_t color = pset_leftmost(colors);
+      colors = pset_discard2(colors, color);
+      engine_undo(engine, 0);
+      engine_restrict(engine, cell, color);
+      if (engine_propagate(engine)) {
+        memcpy(pool + last * ncells, engine->cells, ncells * sizeof(pset_t));
+        last++;
+      }
+    }
+  }
+
+  /* the subproblems left are moved to the front of the pool */
+  memmove(pool, pool + first * ncells, (last - first) * ncells * sizeof(pset_t));
+  shared->subproblems = pool;
+  shared->nsubproblems = last - first;
+  return true;
+}
+
+
+int engine_search_parallel (int size, const pset_t *cells, int jobs,
+                            bool bitboards, uint64_t limit,
+                            engine_solution_fn on_solution, void *data,
+                            budget_t *budget, uint64_t *solutions)
+{
+  budget_t unlimited;
+  shared_t shared;
+  int result = ENGINE_DONE;
+  engine_t *engine = engine_new(size);
+
+  if (budget == NULL) {
+    budget_init(&unlimited, 0, 0);
+    budget = &unlimited;
+  }
+
+  shared.size = size;
+  shared.bitboards = bitboards;
+  shared.subproblems = NULL;
+  shared.nsubproblems = 0;
+  shared.next = 0;
+  pthread_mutex_init(&shared.lock, NULL);
+  shared.solutions = 0;
+  shared.limit = limit;
+  shared.limit_reached = false;
+  shared.on_solution = on_solution;
+  shared.data = data;
+  shared.jobs = jobs;
+  shared.budgets = engine_alloc(jobs, sizeof(budget_t));
+  for (int i = 0; i<jobs; i++) {
+    budget_fork(&shared.budgets[i], budget);
+  }
+
+  engine_load(engine, cells);
+  engine->budget = budget;
+  if (split(engine, &shared, jobs * SUBPROBLEMS_PER_JOB) &&
+      !budget_exceeded(budget)) {
+    job_t *job = engine_alloc(jobs, sizeof(job_t));
+    for (int i = 0; i<jobs; i++) {
+      job[i].shared = &shared;
+      job[i].job = i;
+      if (pthread_create(&job[i].thread, NULL, job_main, &job[i]) != 0) {
+        fprintf(stderr,"sudoku: error: can't create a thread.\n");
+        exit(EXIT_FAILURE);
+      }
+    }
+    for (int i = 0; i<jobs; i++) {
+      pthread_join(job[i].thread, NULL);
+    }
+    free(job);
+  }
+
+  for (int i = 0; i<jobs; i++) {
+    budget_join(&shared.budgets[i]);
+  }
+
+  if (shared.limit_reached) {
+    result = ENGINE_LIMIT;
+  } else if (budget_exceeded(budget)) {
+    result = ENGINE_STOPPED;
+  }
+  *solutions = shared.solutions;
+
+  free(shared.budgets);
+  free(shared.subproblems);
+  pthread_mutex_destroy(&shared.lock);
+  if (budget == &unlimited) {
+    budget_free(&unlimited);
+  }
+  engine_free(engine);
+  return result;
+}
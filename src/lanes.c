@@ -0,0 +1,162 @@
+#include <lanes.h>
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* the widest vector is 64 bytes : 32 lanes of 16 bits */
+#define MAX_WIDTH 32
+
+typedef uint16_t v8u16 __attribute__ ((vector_size (16)));
+typedef uint16_t v16u16 __attribute__ ((vector_size (32)));
+typedef uint16_t v32u16 __attribute__ ((vector_size (64)));
+
+#define LANES_VECTOR v8u16
+#define LANES_KERNEL propagate_sse2
+#if defined(__x86_64__) || defined(__i386__)
+#define LANES_TARGET __attribute__ ((target ("sse2")))
+#else
+#define LANES_TARGET
+#endif
+#include "lanes_kernel.h"
+#undef LANES_VECTOR
+#undef LANES_KERNEL
+#undef LANES_TARGET
+
+#if defined(__x86_64__) || defined(__i386__)
+#define LANES_VECTOR v16u16
+#define LANES_KERNEL propagate_avx2
+#define LANES_TARGET __attribute__ ((target ("avx2")))
+#include "lanes_kernel.h"
+#undef LANES_VECTOR
+#undef LANES_KERNEL
+#undef LANES_TARGET
+
+#define LANES_VECTOR v32u16
+#define LANES_KERNEL propagate_avx512
+#define LANES_TARGET __attribute__ ((target ("avx512f,avx512bw")))
+#include "lanes_kernel.h"
+#undef LANES_VECTOR
+#undef LANES_KERNEL
+#undef LANES_TARGET
+#endif
+
+
+/* 0 until the processor has been looked at */
+static int width;
+static const char *target;
+
+
+static void choose_target (void)
+{
+  width = 8;
+  target = "sse2";
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512bw")) {
+    width = 32;
+    target = "avx512";
+  } else if (__builtin_cpu_supports("avx2")) {
+    width = 16;
+    target = "avx2";
+  }
+#endif
+}
+
+
+int lanes_width (void)
+{
+  if (width == 0) {
+    choose_target();
+  }
+  return width;
+}
+
+
+const char *lanes_target (void)
+{
+  if (width == 0) {
+    choose_target();
+  }
+  return target;
+}
+
+
+/* the 3*size units : lines, rows, then blocks */
+static void build_units (int size, int *units)
+{
+  int block = (size == 16) ? 4 : 3;
+
+  for (int j = 0; j<size; j++) {
+    for (int i = 0; i<size; i++) {
+      int b = (j / block) * block + i / block;
+      int position = (j % block) * block + i % block;
+      units[j * size + i] = j * size + i;
+      units[(size + i) * size + j] = j * size + i;
+      units[(2 * size + b) * size + position] = j * size + i;
+    }
+  }
+}
+
+
+void lanes_propagate (int size, int count, uint16_t *grids, int *status)
+{
+  int ncells = size * size;
+  int units[3 * LANES_MAX_SIZE * LANES_MAX_SIZE];
+  uint16_t full = (uint16_t)((1u << size) - 1);
+  int lanes = lanes_width();
+  /* one vector per cell, lanes being the grids of the chunk */
+  void *vectors;
+  uint16_t bad[MAX_WIDTH];
+
+  if (posix_memalign(&vectors, 64, ncells * lanes * sizeof(uint16_t)) != 0) {
+    for (int k = 0; k<count; k++) {
+      status[k] = LANES_OPEN;
+    }
+    return;
+  }
+  uint16_t *cells = vectors;
+  build_units(size, units);
+
+  for (int first = 0; first<count; first += lanes) {
+    int chunk = (count - first < lanes) ? count - first : lanes;
+
+    /* unused lanes get grids with every cell full : they never change */
+    for (int c = 0; c<ncells; c++) {
+      for (int k = 0; k<lanes; k++) {
+        cells[c * lanes + k] = (k < chunk) ? grids[(first + k) * ncells + c]
+                                           : full;
+      }
+    }
+
+    if (lanes == 32) {
+#if defined(__x86_64__) || defined(__i386__)
+      propagate_avx512(size, units, vectors, full, bad);
+#endif
+    } else if (lanes == 16) {
+#if defined(__x86_64__) || defined(__i386__)
+      propagate_avx2(size, units, vectors, full, bad);
+#endif
+    } else {
+      propagate_sse2(size, units, vectors, full, bad);
+    }
+
+    for (int k = 0; k<chunk; k++) {
+      bool solved = true;
+      for (int c = 0; c<ncells; c++) {
+        uint16_t x = cells[c * lanes + k];
+        grids[(first + k) * ncells + c] = x;
+        if ((x & (x - 1)) != 0) {
+          solved = false;
+        }
+      }
+      if (bad[k] != 0) {
+        status[first + k] = LANES_INCONSISTENT;
+      } else {
+        status[first + k] = solved ? LANES_SOLVED : LANES_OPEN;
+      }
+    }
+  }
+
+  free(vectors);
+}
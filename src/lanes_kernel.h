@@ -0,0 +1,71 @@
+/* Body of a lockstep propagation kernel, included by lanes.c once per
+   instruction set with LANES_VECTOR (a vector of 16-bit lanes),
+   LANES_KERNEL (the name of the function) and LANES_TARGET defined.
+
+   cells holds one vector per cell, lane k being the grid k. bad[k] is set
+   to non-zero if a contradiction has been met in the grid k. */
+static LANES_TARGET void LANES_KERNEL (int size, const int *units,
+                                       LANES_VECTOR *cells,
+                                       uint16_t full_colors, uint16_t *bad_lanes)
+{
+  LANES_VECTOR zero = {0};
+  LANES_VECTOR one = zero + 1;
+  LANES_VECTOR full = zero + full_colors;
+  LANES_VECTOR bad = zero;
+  bool changed = true;
+
+  while (changed) {
+    LANES_VECTOR diff = zero;
+
+    for (int u = 0; u<3 * size; u++) {
+      const int *unit = units + u * size;
+      LANES_VECTOR placed = zero;
+      LANES_VECTOR once = zero;
+      LANES_VECTOR twice = zero;
+
+      /* the colors of the singletons, twice the same one is a
+         contradiction */
+      for (int i = 0; i<size; i++) {
+        LANES_VECTOR x = cells[unit[i]];
+        LANES_VECTOR single = (LANES_VECTOR)((x & (x - one)) == zero);
+        bad |= placed & x & single;
+        placed |= x & single;
+      }
+
+      /* cross-hatching, and counting where each color can still go */
+      for (int i = 0; i<size; i++) {
+        LANES_VECTOR x = cells[unit[i]];
+        LANES_VECTOR single = (LANES_VECTOR)((x & (x - one)) == zero);
+        LANES_VECTOR reduced = x & (single | ~placed);
+        bad |= (LANES_VECTOR)(reduced == zero);
+        twice |= once & reduced;
+        once |= reduced;
+        diff |= x ^ reduced;
+        cells[unit[i]] = reduced;
+      }
+
+      /* lone number : a color found in only one cell is placed there */
+      bad |= full & ~once;
+      LANES_VECTOR lone = once & ~twice;
+      for (int i = 0; i<size; i++) {
+        LANES_VECTOR x = cells[unit[i]];
+        LANES_VECTOR found = x & lone;
+        LANES_VECTOR has_lone = (LANES_VECTOR)(found != zero);
+        /* two lone colors in the same cell */
+        bad |= found & (found - one);
+        cells[unit[i]] = (found & has_lone) | (x & ~has_lone);
+        diff |= x ^ cells[unit[i]];
+      }
+    }
+
+    /* bad lanes are left alone, they only get smaller and can't loop */
+    changed = false;
+    for (unsigned k = 0; k<sizeof(LANES_VECTOR) / sizeof(uint16_t); k++) {
+      if (diff[k] != 0 && bad[k] == 0) {
+        changed = true;
+      }
+    }
+  }
+
+  memcpy(bad_lanes, &bad, sizeof(bad));
+}
@@ -0,0 +1,415 @@
+#include <metrics.h>
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+/* A shard has one writer, its thread, and is read by the thread writing the
+   file : the writer stores its counters with plain (relaxed atomic) stores,
+   no read-modify-write and no lock is needed. */
+#ifdef __GNUC__
+#define LOAD(x) __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define STORE(x, value) __atomic_store_n(&(x), (value), __ATOMIC_RELAXED)
+#define LOAD_POINTER(x) __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+#define STORE_POINTER(x, value) \
+  __atomic_store_n(&(x), (value), __ATOMIC_RELEASE)
+#else
+#define LOAD(x) (x)
+#define STORE(x, value) ((x) = (value))
+#define LOAD_POINTER(x) (x)
+#define STORE_POINTER(x, value) ((x) = (value))
+#endif
+
+static const char *result_names[METRICS_RESULTS] = {
+  "unique", "multiple", "inconsistent", "unknown"
+};
+
+typedef struct {
+  uint64_t buckets[METRICS_BUCKETS];
+  uint64_t count;
+  uint64_t sum;             /* nanoseconds */
+} histogram_t;
+
+struct metrics_shard {
+  /* METRICS_RESULTS histograms for each block size, allocated by the
+     writer of the shard the first time it records a grid of that size */
+  histogram_t *histograms[METRICS_MAX_BLOCK + 1];
+  uint64_t puzzles;
+  uint64_t nodes;
+  char padding[64];         /* two shards never share a cache line */
+};
+
+struct metrics {
+  metrics_shard_t *shards;
+  int nshards;
+  uint64_t start;
+
+  char *path;
+  long interval_ms;
+  bool writing;             /* the writing thread is running */
+  bool stop;
+  pthread_t writer;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+};
+
+
+static void *metrics_alloc (size_t count, size_t size)
+{
+  void *res = calloc(count, size);
+  if (res == NULL) {
+    fprintf(stderr,"sudoku: error: out of memory.\n");
+    exit(EXIT_FAILURE);
+  }
+  return res;
+}
+
+
+uint64_t metrics_now (void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+
+/* below METRICS_SUB_BUCKETS ns, one bucket per value. Above, the bucket is
+   given by the position of the highest bit and the METRICS_SUB_BITS bits
+   which follow it. */
+static int bucket_of (uint64_t ns)
+{
+  if (ns < METRICS_SUB_BUCKETS) {
+    return ns;
+  }
+
+  int shift = 0;
+  while ((ns >> shift) >= 2 * METRICS_SUB_BUCKETS) {
+    shift++;
+  }
+  int bucket = shift * METRICS_SUB_BUCKETS + (ns >> shift);
+  return (bucket < METRICS_BUCKETS) ? bucket : METRICS_BUCKETS - 1;
+}
+
+
+/* the smallest latency which is counted in the bucket after bucket */
+static uint64_t bucket_end (int bucket)
+{
+  if (bucket < METRICS_SUB_BUCKETS) {
+    return bucket + 1;
+  }
+  int shift = bucket / METRICS_SUB_BUCKETS - 1;
+  uint64_t mantissa = bucket % METRICS_SUB_BUCKETS + METRICS_SUB_BUCKETS;
+  return (mantissa + 1) << shift;
+}
+
+
+static int block_of (int size)
+{
+  int block = 1;
+  while (block * block < size) {
+    block++;
+  }
+  return (block <= METRICS_MAX_BLOCK) ? block : 0;
+}
+
+
+/* the thread writing the metrics file */
+static void *writer_main (void *data)
+{
+  metrics_t *metrics = data;
+
+  pthread_mutex_lock(&metrics->lock);
+  while (!metrics->stop) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += metrics->interval_ms / 1000;
+    deadline.tv_nsec += (metrics->interval_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_cond_timedwait(&metrics->wake, &metrics->lock, &deadline);
+
+    if (!metrics->stop) {
+      pthread_mutex_unlock(&metrics->lock);
+      metrics_write(metrics, NULL);
+      pthread_mutex_lock(&metrics->lock);
+    }
+  }
+  pthread_mutex_unlock(&metrics->lock);
+  return NULL;
+}
+
+
+metrics_t *metrics_new (int shards, const char *path, long interval_ms)
+{
+  metrics_t *metrics = metrics_alloc(1, sizeof(metrics_t));
+
+  metrics->shards = metrics_alloc(shards, sizeof(metrics_shard_t));
+  metrics->nshards = shards;
+  metrics->start = metrics_now();
+  metrics->interval_ms = (interval_ms > 0) ? interval_ms : METRICS_INTERVAL_MS;
+  pthread_mutex_init(&metrics->lock, NULL);
+  pthread_cond_init(&metrics->wake, NULL);
+
+  if (path != NULL) {
+    metrics->path = metrics_alloc(strlen(path) + 1, 1);
+    strcpy(metrics->path, path);
+    metrics->writing = (pthread_create(&metrics->writer, NULL, writer_main,
+                                       metrics) == 0);
+  }
+  return metrics;
+}
+
+
+metrics_shard_t *metrics_shard (metrics_t *metrics, int k)
+{
+  return &metrics->shards[k];
+}
+
+
+void metrics_record (metrics_shard_t *shard, int size, int result,
+                     uint64_t latency_ns, uint64_t nodes)
+{
+  int block = block_of(size);
+  histogram_t *histograms = shard->histograms[block];
+
+  if (histograms == NULL) {
+    histograms = metrics_alloc(METRICS_RESULTS, sizeof(histogram_t));
+    STORE_POINTER(shard->histograms[block], histograms);
+  }
+
+  histogram_t *histogram = &histograms[result];
+  int bucket = bucket_of(latency_ns);
+  STORE(histogram->buckets[bucket], histogram->buckets[bucket] + 1);
+  STORE(histogram->count, histogram->count + 1);
+  STORE(histogram->sum, histogram->sum + latency_ns);
+  STORE(shard->puzzles, shard->puzzles + 1);
+  STORE(shard->nodes, shard->nodes + nodes);
+}
+
+
+/* add the histograms of block and result of every shard into total.
+   return false if there is no grid there. */
+static bool merge (metrics_t *metrics, int block, int result,
+                   histogram_t *total)
+{
+  memset(total, 0, sizeof(histogram_t));
+  for (int k = 0; k<metrics->nshards; k++) {
+    metrics_shard_t *shard = &metrics->shards[k];
+    histogram_t *histograms = LOAD_POINTER(shard->histograms[block]);
+    if (histograms != NULL) {
+      histogram_t *histogram = &histograms[result];
+      for (int i = 0; i<METRICS_BUCKETS; i++) {
+        total->buckets[i] += LOAD(histogram->buckets[i]);
+      }
+      total->count += LOAD(histogram->count);
+      total->sum += LOAD(histogram->sum);
+    }
+  }
+  return (total->count > 0);
+}
+
+
+/* the latency under which a fraction of the grids has been, in ns (the end
+   of its bucket, so it is at most 6% too big) */
+static uint64_t percentile (const histogram_t *histogram, double fraction)
+{
+  uint64_t rank = fraction * histogram->count;
+  uint64_t seen = 0;
+
+  if (rank >= histogram->count) {
+    rank = histogram->count - 1;
+  }
+
+  for (int i = 0; i<METRICS_BUCKETS; i++) {
+    seen += histogram->buckets[i];
+    if (seen > rank) {
+      return bucket_end(i);
+    }
+  }
+  return bucket_end(METRICS_BUCKETS - 1);
+}
+
+
+static void totals (metrics_t *metrics, uint64_t *puzzles, uint64_t *nodes,
+                    double *seconds, long *peak_rss_kb)
+{
+  struct rusage usage;
+
+  *puzzles = 0;
+  *nodes = 0;
+  for (int k = 0; k<metrics->nshards; k++) {
+    *puzzles += LOAD(metrics->shards[k].puzzles);
+    *nodes += LOAD(metrics->shards[k].nodes);
+  }
+  *seconds = (metrics_now() - metrics->start) / 1e9;
+  *peak_rss_kb = (getrusage(RUSAGE_SELF, &usage) == 0) ? usage.ru_maxrss : 0;
+}
+
+
+static void write_prometheus (metrics_t *metrics, FILE *file)
+{
+  uint64_t puzzles, nodes;
+  double seconds;
+  long peak_rss_kb;
+  histogram_t total;
+
+  totals(metrics, &puzzles, &nodes, &seconds, &peak_rss_kb);
+  fprintf(file,
+          "# HELP sudoku_puzzles_total Grids solved or generated.\n"
+          "# TYPE sudoku_puzzles_total counter\n"
+          "sudoku_puzzles_total %llu\n"
+          "# HELP sudoku_nodes_total Nodes of the search trees.\n"
+          "# TYPE sudoku_nodes_total counter\n"
+          "sudoku_nodes_total %llu\n"
+          "# HELP sudoku_puzzles_per_second Grids per second since the start.\n"
+          "# TYPE sudoku_puzzles_per_second gauge\n"
+          "sudoku_puzzles_per_second %.3f\n"
+          "# HELP sudoku_nodes_per_second Nodes per second since the start.\n"
+          "# TYPE sudoku_nodes_per_second gauge\n"
+          "sudoku_nodes_per_second %.3f\n"
+          "# HELP sudoku_peak_rss_bytes Peak resident memory.\n"
+          "# TYPE sudoku_peak_rss_bytes gauge\n"
+          "sudoku_peak_rss_bytes %llu\n",
+          (unsigned long long) puzzles, (unsigned long long) nodes,
+          (seconds > 0) ? puzzles / seconds : 0.0,
+          (seconds > 0) ? nodes / seconds : 0.0,
+          (unsigned long long) peak_rss_kb * 1024);
+
+  fprintf(file,
+          "# HELP sudoku_latency_seconds Time taken by a grid.\n"
+          "# TYPE sudoku_latency_seconds histogram\n");
+  for (int block = 0; block<=METRICS_MAX_BLOCK; block++) {
+    for (int result = 0; result<METRICS_RESULTS; result++) {
+      if (!merge(metrics, block, result, &total)) {
+        continue;
+      }
+
+      /* the Prometheus buckets are the powers of two of nanoseconds, up to
+         the last one which isn't empty */
+      int last = METRICS_BUCKETS - 1;
+      while (total.buckets[last] == 0) {
+        last--;
+      }
+      uint64_t cumulated = 0;
+      for (int i = 0; i<=last; i++) {
+        cumulated += total.buckets[i];
+        if ((i + 1) % METRICS_SUB_BUCKETS == 0) {
+          fprintf(file, "sudoku_latency_seconds_bucket{size=\"%d\","
+                        "result=\"%s\",le=\"%.9g\"} %llu\n",
+                  block * block, result_names[result], bucket_end(i) / 1e9,
+                  (unsigned long long) cumulated);
+        }
+      }
+      fprintf(file, "sudoku_latency_seconds_bucket{size=\"%d\",result=\"%s\","
+                    "le=\"+Inf\"} %llu\n",
+              block * block, result_names[result],
+              (unsigned long long) total.count);
+      fprintf(file, "sudoku_latency_seconds_sum{size=\"%d\",result=\"%s\"} "
+                    "%.9f\n",
+              block * block, result_names[result], total.sum / 1e9);
+      fprintf(file, "sudoku_latency_seconds_count{size=\"%d\",result=\"%s\"} "
+                    "%llu\n",
+              block * block, result_names[result],
+              (unsigned long long) total.count);
+    }
+  }
+}
+
+
+void metrics_write (metrics_t *metrics, FILE *file)
+{
+  if (file != NULL) {
+    write_prometheus(metrics, file);
+    return;
+  }
+
+  /* the file is replaced at once, so a reader never sees half of it */
+  char *temporary = metrics_alloc(strlen(metrics->path) + 5, 1);
+  sprintf(temporary, "%s.tmp", metrics->path);
+  file = fopen(temporary, "w");
+  if (file != NULL) {
+    write_prometheus(metrics, file);
+    if (fclose(file) == 0) {
+      rename(temporary, metrics->path);
+    }
+  }
+  free(temporary);
+}
+
+
+/* print a latency given in ns with a readable unit */
+static void latency_print (FILE *file, const char *name, uint64_t ns)
+{
+  if (ns < 1000) {
+    fprintf(file, " %s %llu ns", name, (unsigned long long) ns);
+  } else if (ns < 1000000) {
+    fprintf(file, " %s %.1f us", name, ns / 1e3);
+  } else if (ns < 1000000000) {
+    fprintf(file, " %s %.1f ms", name, ns / 1e6);
+  } else {
+    fprintf(file, " %s %.2f s", name, ns / 1e9);
+  }
+}
+
+
+void metrics_summary (metrics_t *metrics, FILE *file)
+{
+  uint64_t puzzles, nodes;
+  double seconds;
+  long peak_rss_kb;
+  histogram_t total;
+
+  totals(metrics, &puzzles, &nodes, &seconds, &peak_rss_kb);
+  fprintf(file, "sudoku: %llu grids in %.3f s, %.0f grids/s, %.0f nodes/s, "
+                "peak RSS %.1f MB\n",
+          (unsigned long long) puzzles, seconds,
+          (seconds > 0) ? puzzles / seconds : 0.0,
+          (seconds > 0) ? nodes / seconds : 0.0, peak_rss_kb / 1024.0);
+
+  for (int block = 0; block<=METRICS_MAX_BLOCK; block++) {
+    for (int result = 0; result<METRICS_RESULTS; result++) {
+      if (!merge(metrics, block, result, &total)) {
+        continue;
+      }
+      fprintf(file, "  %dx%d %s: %llu grids,", block * block, block * block,
+              result_names[result], (unsigned long long) total.count);
+      latency_print(file, "mean", total.sum / total.count);
+      latency_print(file, "p50", percentile(&total, 0.5));
+      latency_print(file, "p90", percentile(&total, 0.9));
+      latency_print(file, "p99", percentile(&total, 0.99));
+      latency_print(file, "max", percentile(&total, 1.0));
+      fprintf(file, "\n");
+    }
+  }
+}
+
+
+void metrics_free (metrics_t *metrics)
+{
+  if (metrics->writing) {
+    pthread_mutex_lock(&metrics->lock);
+    metrics->stop = true;
+    pthread_cond_signal(&metrics->wake);
+    pthread_mutex_unlock(&metrics->lock);
+    pthread_join(metrics->writer, NULL);
+  }
+  if (metrics->path != NULL) {
+    metrics_write(metrics, NULL);
+    free(metrics->path);
+  }
+
+  for (int k = 0; k<metrics->nshards; k++) {
+    for (int block = 0; block<=METRICS_MAX_BLOCK; block++) {
+      free(metrics->shards[k].histograms[block]);
+    }
+  }
+  free(metrics->shards);
+  pthread_cond_destroy(&metrics->wake);
+  pthread_mutex_destroy(&metrics->lock);
+  free(metrics);
+}
@@ -8,28 +8,29 @@ static const char color_table[] = "123456789"
 pset_t char2pset (char c)
 {
   int i = 0; /*we could call it position_of_the_found_color_in_color_table*/
-  while (i < MAX_COLORS) {
+  while (i < CHAR_COLORS) {
   /*the complexity is n cause the loop stops when i reaches 64 and it
    increments each time*/
     if (c==color_table[i]) {
-      return ((pset_t)1<<i);
+      return pset_from_index(i);
       break;
     }
     i++;
   }
-  return 0;
+  return pset_empty();
 }
 
 
 void pset2str (char string[MAX_COLORS + 1], pset_t pset)
 {
   int j = 0;
-  for (int i = 0; i<MAX_COLORS; i++) {
-    if (pset & 1) {
+  uint64_t word = pset_first_word(pset);
+  for (int i = 0; i<CHAR_COLORS; i++) {
+    if (word & 1) {
       string[j] = color_table[i];
       j++;
     }
-    pset = pset >> 1;
+    word = word >> 1;
   }
   string[j] = '\0';
 }
@@ -37,17 +38,34 @@ void pset2str (char string[MAX_COLORS + 1], pset_t pset)
 
 pset_t pset_full (size_t color_range)
 {
+#if PSET_WORDS == 1
   pset_t res = FULL;
   if (color_range < MAX_COLORS) {
     res = FULL >> (MAX_COLORS - color_range);
   }
   return res;
+#else
+  pset_t res = pset_empty();
+  for (int w = 0; w<PSET_WORDS; w++) {
+    if (color_range >= 64 * (size_t)(w + 1)) {
+      res[w] = FULL;
+    } else if (color_range > 64 * (size_t)w) {
+      res[w] = FULL >> (64 * (w + 1) - color_range);
+    }
+  }
+  return res;
+#endif
 }
 
 
 pset_t pset_empty(void)
 {
+#if PSET_WORDS == 1
   return 0;
+#else
+  pset_t res = {0};
+  return res;
+#endif
 }
 
 
@@ -95,44 +113,159 @@ pset_t pset_xor (pset_t pset1, pset_t pset2)
 
 bool pset_is_included (pset_t pset1, pset_t pset2)
 {
-  return ((pset1 - (pset1 & pset2)) == 0);
+  return pset_is_empty(pset_discard2(pset1, pset2));
+}
+
+
+bool pset_is_empty (pset_t pset)
+{
+#if PSET_WORDS == 1
+  return (pset == 0);
+#else
+  uint64_t any = 0;
+  for (int w = 0; w<PSET_WORDS; w++) {
+    any |= pset[w];
+  }
+  return (any == 0);
+#endif
+}
+
+
+bool pset_equal (pset_t pset1, pset_t pset2)
+{
+  return pset_is_empty(pset_xor(pset1, pset2));
 }
 
 
 bool pset_is_singleton (pset_t pset)
 {
+#if PSET_WORDS == 1
   return (((pset & (pset-1)) == 0) && pset != 0);
+#else
+  /* one word holds a single color and the others are empty */
+  int words = 0;
+  bool single = true;
+  for (int w = 0; w<PSET_WORDS; w++) {
+    if (pset[w] != 0) {
+      words++;
+      single = single && ((pset[w] & (pset[w] - 1)) == 0);
+    }
+  }
+  return (words == 1 && single);
+#endif
 }
 
 
-size_t pset_cardinality (pset_t pset)
+static size_t word_cardinality (uint64_t word)
 /*inspired on the website http://stackoverflow.com. Article by an annonymous.
   SWAR algorithm*/
 {
-  pset = pset - ((pset >> 1 ) & 0x5555555555555555);
-  pset = (pset & 0x3333333333333333) + ((pset >> 2) & 0x3333333333333333);
-  pset = (pset + (pset >> 4)) & 0x0F0F0F0F0F0F0F0F;
-  pset = pset + (pset >> 8);
-  pset = pset + (pset >> 16);
-  pset = pset + (pset >> 32); 
+  word = word - ((word >> 1 ) & 0x5555555555555555);
+  word = (word & 0x3333333333333333) + ((word >> 2) & 0x3333333333333333);
+  word = (word + (word >> 4)) & 0x0F0F0F0F0F0F0F0F;
+  word = word + (word >> 8);
+  word = word + (word >> 16);
+  word = word + (word >> 32); 
   
-  return (pset & 0xFF);
+  return (word & 0xFF);
+}
+
+
+size_t pset_cardinality (pset_t pset)
+{
+#if PSET_WORDS == 1
+  return word_cardinality(pset);
+#else
+  size_t res = 0;
+  for (int w = 0; w<PSET_WORDS; w++) {
+    res += word_cardinality(pset[w]);
+  }
+  return res;
+#endif
 }
 
 
 pset_t pset_leftmost (pset_t pset)
 {
-  pset_t res = 1;
-  
+  /* in two's complement, -pset keeps the lowest bit set and flips the ones
+     above it. It also gives 0 for the empty set. */
+#if PSET_WORDS == 1
+  return pset_and (pset, ~pset + 1);
+#else
+  pset_t res = pset_empty();
+  for (int w = 0; w<PSET_WORDS; w++) {
+    if (pset[w] != 0) {
+      res[w] = pset[w] & (~pset[w] + 1);
+      break;
+    }
+  }
+  return res;
+#endif
+}
+
+
+static int word_index (uint64_t word)
+{
+#ifdef __GNUC__
+  return __builtin_ctzll(word);
+#else
+  int res = 0;
+  while ((word & 1) == 0) {
+    word = word >> 1;
+    res++;
+  }
+  return res;
+#endif
+}
+
+
+int pset_index (pset_t pset)
+{
+#if PSET_WORDS == 1
   if (pset == pset_empty()) {
-    return pset_empty();
+    return -1;
   }
-  
-  while ( pset_and (pset, res) == pset_empty() ) {
-    res = res << 1;
+  return word_index(pset);
+#else
+  for (int w = 0; w<PSET_WORDS; w++) {
+    if (pset[w] != 0) {
+      return 64 * w + word_index(pset[w]);
+    }
   }
-  
+  return -1;
+#endif
+}
+
+
+pset_t pset_from_index (int index)
+{
+#if PSET_WORDS == 1
+  return ((pset_t)1 << index);
+#else
+  pset_t res = pset_empty();
+  res[index / 64] = (uint64_t)1 << (index % 64);
   return res;
+#endif
 }
 
 
+uint64_t pset_first_word (pset_t pset)
+{
+#if PSET_WORDS == 1
+  return pset;
+#else
+  return pset[0];
+#endif
+}
+
+
+pset_t pset_from_first_word (uint64_t word)
+{
+#if PSET_WORDS == 1
+  return word;
+#else
+  pset_t res = pset_empty();
+  res[0] = word;
+  return res;
+#endif
+}
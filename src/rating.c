@@ -0,0 +1,344 @@
+#include <rating.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* what a technique did to the grid */
+#define STUCK 0
+#define PROGRESS 1
+#define CONTRADICTION -1
+
+static const double weights[RATING_TECHNIQUES] = {1.0, 1.5, 2.5, 3.0, 4.0};
+
+static const char *names[RATING_TECHNIQUES] = {
+  "naked single", "hidden single", "locked candidates", "naked pair",
+  "branching"
+};
+
+
+static void *rating_alloc (size_t count, size_t size)
+{
+  void *res = calloc(count, size);
+  if (res == NULL) {
+    fprintf(stderr,"sudoku: error: out of memory.\n");
+    exit(EXIT_FAILURE);
+  }
+  return res;
+}
+
+
+rating_t *rating_new (int size, budget_t *parent)
+{
+  rating_t *rating = rating_alloc(1, sizeof(rating_t));
+
+  rating->engine = engine_new(size);
+  rating->parent = parent;
+  rating->engine->budget = &rating->budget;
+  rating->cells = rating_alloc(size * size, sizeof(pset_t));
+  rating->placed = rating_alloc(size * size, sizeof(bool));
+  rating->given = rating_alloc(size * size, sizeof(bool));
+  return rating;
+}
+
+
+void rating_free (rating_t *rating)
+{
+  engine_free(rating->engine);
+  free(rating->cells);
+  free(rating->placed);
+  free(rating->given);
+  free(rating);
+}
+
+
+static int eliminate (rating_t *rating, int cell, pset_t colors)
+{
+  pset_t old = rating->cells[cell];
+  pset_t res = pset_discard2(old, colors);
+
+  if (pset_equal(res, old)) {
+    return STUCK;
+  }
+  rating->cells[cell] = res;
+  return pset_is_empty(res) ? CONTRADICTION : PROGRESS;
+}
+
+
+/* remove the color of a singleton from the other cells of its units */
+static int place (rating_t *rating, int cell)
+{
+  engine_t *engine = rating->engine;
+  int size = engine->size;
+
+  rating->placed[cell] = true;
+  for (int k = 0; k<3; k++) {
+    const int *unit = engine->units + engine->cell_units[3 * cell + k] * size;
+    for (int i = 0; i<size; i++) {
+      if (unit[i] != cell &&
+          eliminate(rating, unit[i], rating->cells[cell]) == CONTRADICTION) {
+        return CONTRADICTION;
+      }
+    }
+  }
+  return PROGRESS;
+}
+
+
+static int naked_singles (rating_t *rating, uint64_t *uses)
+{
+  int result = STUCK;
+
+  for (int cell = 0; cell<rating->engine->ncells; cell++) {
+    if (!rating->placed[cell] && pset_is_singleton(rating->cells[cell])) {
+      if (!rating->given[cell]) {
+        (*uses)++;
+      }
+      if (place(rating, cell) == CONTRADICTION) {
+        return CONTRADICTION;
+      }
+      result = PROGRESS;
+    }
+  }
+  return result;
+}
+
+
+static int hidden_singles (rating_t *rating, uint64_t *uses)
+{
+  engine_t *engine = rating->engine;
+  int size = engine->size;
+  int result = STUCK;
+
+  for (int u = 0; u<3 * size; u++) {
+    const int *unit = engine->units + u * size;
+    pset_t once = pset_empty();
+    pset_t twice = pset_empty();
+
+    for (int i = 0; i<size; i++) {
+      twice = pset_or(twice, pset_and(once, rating->cells[unit[i]]));
+      once = pset_or(once, rating->cells[unit[i]]);
+    }
+    if (!pset_equal(once, engine->full)) {
+      return CONTRADICTION;
+    }
+
+    pset_t lone = pset_discard2(once, twice);
+    for (int i = 0; i<size && !pset_is_empty(lone); i++) {
+      pset_t found = pset_and(rating->cells[unit[i]], lone);
+      if (!pset_is_empty(found) &&
+          !pset_is_singleton(rating->cells[unit[i]])) {
+        /* two lone colors in the same cell can't be both placed */
+        if (!pset_is_singleton(found)) {
+          return CONTRADICTION;
+        }
+        rating->cells[unit[i]] = found;
+        (*uses)++;
+        if (place(rating, unit[i]) == CONTRADICTION) {
+          return CONTRADICTION;
+        }
+        result = PROGRESS;
+      }
+    }
+  }
+  return result;
+}
+
+
+/* if the cells of a color in the unit u all are in the same unit of
+   another kind (a block and a line or a row), the color goes in one of them
+   and can be removed from the rest of that unit */
+static int locked_candidates (rating_t *rating, uint64_t *uses)
+{
+  engine_t *engine = rating->engine;
+  int size = engine->size;
+  int result = STUCK;
+
+  for (int u = 0; u<3 * size; u++) {
+    const int *unit = engine->units + u * size;
+    int kind = u / size;
+
+    for (int c = 0; c<size; c++) {
+      pset_t color = pset_from_index(c);
+
+      for (int other = 0; other<3; other++) {
+        int shared = -1;
+        int places = 0;
+
+        if (other == kind) {
+          continue;
+        }
+
+        for (int i = 0; i<size && shared != -2; i++) {
+          if (!pset_is_empty(pset_and(rating->cells[unit[i]], color))) {
+            int v = engine->cell_units[3 * unit[i] + other];
+            shared = (shared == -1 || shared == v) ? v : -2;
+            places++;
+          }
+        }
+        if (places < 2 || shared < 0) {
+          continue;
+        }
+
+        const int *target = engine->units + shared * size;
+        int changed = STUCK;
+        for (int i = 0; i<size; i++) {
+          if (engine->cell_units[3 * target[i] + kind] != u) {
+            int res = eliminate(rating, target[i], color);
+            if (res == CONTRADICTION) {
+              return CONTRADICTION;
+            }
+            changed |= res;
+          }
+        }
+        if (changed == PROGRESS) {
+          (*uses)++;
+          result = PROGRESS;
+        }
+      }
+    }
+  }
+  return result;
+}
+
+
+/* two cells of a unit with the same two colors take both of them */
+static int naked_pairs (rating_t *rating, uint64_t *uses)
+{
+  engine_t *engine = rating->engine;
+  int size = engine->size;
+  int result = STUCK;
+
+  for (int u = 0; u<3 * size; u++) {
+    const int *unit = engine->units + u * size;
+
+    for (int i = 0; i<size; i++) {
+      pset_t pair = rating->cells[unit[i]];
+      if (pset_cardinality(pair) != 2) {
+        continue;
+      }
+      for (int j = i + 1; j<size; j++) {
+        if (!pset_equal(rating->cells[unit[j]], pair)) {
+          continue;
+        }
+        int changed = STUCK;
+        for (int k = 0; k<size; k++) {
+          if (k != i && k != j) {
+            int res = eliminate(rating, unit[k], pair);
+            if (res == CONTRADICTION) {
+              return CONTRADICTION;
+            }
+            changed |= res;
+          }
+        }
+        if (changed == PROGRESS) {
+          (*uses)++;
+          result = PROGRESS;
+        }
+      }
+    }
+  }
+  return result;
+}
+
+
+static int apply (rating_t *rating, int technique, uint64_t *uses)
+{
+  switch (technique) {
+    case RATING_NAKED_SINGLE :
+      return naked_singles(rating, uses);
+    case RATING_HIDDEN_SINGLE :
+      return hidden_singles(rating, uses);
+    case RATING_LOCKED_CANDIDATES :
+      return locked_candidates(rating, uses);
+    default :
+      return naked_pairs(rating, uses);
+  }
+}
+
+
+static void grade_set (grade_t *grade, int hardest)
+{
+  grade->hardest = hardest;
+  grade->grade = (hardest < 0) ? 0.0 : weights[hardest];
+  if (grade->nodes > 0) {
+    grade->grade += log2(grade->nodes);
+  }
+}
+
+
+bool rating_rate (rating_t *rating, const pset_t *cells, double ceiling,
+                  grade_t *grade)
+{
+  engine_t *engine = rating->engine;
+  int hardest = -1;
+  int technique = RATING_NAKED_SINGLE;
+
+  memset(grade, 0, sizeof(grade_t));
+  grade->hardest = -1;
+  memcpy(rating->cells, cells, engine->ncells * sizeof(pset_t));
+  for (int cell = 0; cell<engine->ncells; cell++) {
+    rating->given[cell] = pset_is_singleton(cells[cell]);
+    rating->placed[cell] = false;
+  }
+
+  /* the cheapest technique making progress, then the cheapest again */
+  while (technique < RATING_BRANCHING) {
+    int result = apply(rating, technique, &grade->uses[technique]);
+
+    if (result == CONTRADICTION) {
+      grade_set(grade, hardest);
+      return true;
+    }
+    if (result == STUCK) {
+      technique++;
+      continue;
+    }
+    if (technique > hardest && grade->uses[technique] > 0) {
+      hardest = technique;
+      if (weights[hardest] > ceiling) {
+        grade_set(grade, hardest);
+        return false;
+      }
+    }
+    technique = RATING_NAKED_SINGLE;
+  }
+
+  bool solved = true;
+  for (int cell = 0; cell<engine->ncells; cell++) {
+    solved = solved && pset_is_singleton(rating->cells[cell]);
+  }
+  if (solved) {
+    grade->solutions = 1;
+    grade_set(grade, hardest);
+    return true;
+  }
+
+  /* no technique is left : the search, as short as the ceiling allows */
+  if (weights[RATING_BRANCHING] > ceiling) {
+    grade_set(grade, RATING_BRANCHING);
+    return false;
+  }
+  double most = ceiling - weights[RATING_BRANCHING];
+  budget_fork(&rating->budget, rating->parent);
+  rating->budget.max_nodes = (most < 62) ? (uint64_t) exp2(most) + 1 : 0;
+  engine_load(engine, rating->cells);
+  int result = engine_search(engine, 2, NULL, NULL);
+  grade->nodes = rating->budget.nodes;
+  budget_join(&rating->budget);
+
+  grade->uses[RATING_BRANCHING] = 1;
+  grade->solutions = engine->solutions;
+  grade_set(grade, RATING_BRANCHING);
+  return result != ENGINE_STOPPED && grade->grade <= ceiling;
+}
+
+
+const char *rating_technique_name (int technique)
+{
+  if (technique < 0 || technique >= RATING_TECHNIQUES) {
+    return "none";
+  }
+  return names[technique];
+}
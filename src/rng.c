@@ -0,0 +1,36 @@
+#include <rng.h>
+
+/* splitmix64 finalizer, to turn close seeds into unrelated states */
+static uint64_t mix (uint64_t x)
+{
+  x += 0x9E3779B97F4A7C15;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EB;
+  return x ^ (x >> 31);
+}
+
+
+void rng_seed (rng_t *rng, uint64_t seed, uint64_t stream)
+{
+  rng->state = mix(mix(seed) ^ stream);
+  /* xorshift never leaves the state 0 */
+  if (rng->state == 0) {
+    rng->state = 1;
+  }
+}
+
+
+uint64_t rng_next (rng_t *rng)
+{
+  rng->state ^= rng->state >> 12;
+  rng->state ^= rng->state << 25;
+  rng->state ^= rng->state >> 27;
+  return rng->state * 0x2545F4914F6CDD1D;
+}
+
+
+int rng_below (rng_t *rng, int bound)
+{
+  /* the high bits are the best ones of xorshift64* */
+  return (int)(((rng_next(rng) >> 32) * (uint64_t)bound) >> 32);
+}
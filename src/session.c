@@ -0,0 +1,296 @@
+#include <session.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void *session_alloc (size_t count, size_t size)
+{
+  void *res = calloc(count, size);
+  if (res == NULL) {
+    fprintf(stderr,"sudoku: error: out of memory.\n");
+    exit(EXIT_FAILURE);
+  }
+  return res;
+}
+
+
+session_t *session_new (int size, budget_t *budget)
+{
+  session_t *session = session_alloc(1, sizeof(session_t));
+  int ncells = size * size;
+
+  session->engine = engine_new(size);
+  session->engine->budget = budget;
+  session->given_cell = session_alloc(ncells, sizeof(int));
+  session->given_color = session_alloc(ncells, sizeof(pset_t));
+  session->given_mark = session_alloc(ncells, sizeof(size_t));
+  session->given_at = session_alloc(ncells, sizeof(int));
+  session->solution = session_alloc(ncells, sizeof(pset_t));
+
+  for (int cell = 0; cell<ncells; cell++) {
+    session->solution[cell] = session->engine->full;
+  }
+  session_load(session, session->solution);
+  return session;
+}
+
+
+void session_free (session_t *session)
+{
+  engine_free(session->engine);
+  free(session->given_cell);
+  free(session->given_color);
+  free(session->given_mark);
+  free(session->given_at);
+  free(session->solution);
+  free(session->edits);
+  free(session);
+}
+
+
+/* Place the given k on the grid and propagate it, if the givens before it
+   have been propagated without contradiction. A given which brings a
+   contradiction is undone at once : the engine always holds the grid of
+   the first session->propagated givens. */
+static bool propagate_given (session_t *session, int k)
+{
+  engine_t *engine = session->engine;
+  size_t mark = engine->trail_len;
+
+  session->given_mark[k] = mark;
+  if (!session->base_consistent || session->propagated != k) {
+    return false;
+  }
+  if (!engine_restrict(engine, session->given_cell[k],
+                       session->given_color[k]) ||
+      !engine_propagate(engine)) {
+    engine_undo(engine, mark);
+    return false;
+  }
+  session->propagated = k + 1;
+  return true;
+}
+
+
+bool session_load (session_t *session, const pset_t *cells)
+{
+  engine_t *engine = session->engine;
+
+  /* the singletons are left to the givens */
+  for (int cell = 0; cell<engine->ncells; cell++) {
+    pset_t colors = cells[cell];
+    engine->cells[cell] = pset_is_singleton(colors) ? engine->full : colors;
+  }
+  engine_load(engine, engine->cells);
+  session->base_consistent = engine_propagate(engine);
+
+  session->givens = 0;
+  session->propagated = 0;
+  session->solutions = -1;
+  session->nedits = 0;
+  for (int cell = 0; cell<engine->ncells; cell++) {
+    session->given_at[cell] = -1;
+  }
+  for (int cell = 0; cell<engine->ncells; cell++) {
+    if (pset_is_singleton(cells[cell])) {
+      int k = session->givens;
+      session->given_cell[k] = cell;
+      session->given_color[k] = cells[cell];
+      session->given_at[cell] = k;
+      session->givens++;
+      propagate_given(session, k);
+    }
+  }
+  return session_consistent(session);
+}
+
+
+/* the given of cell, an empty set if it has none */
+static pset_t given_of (const session_t *session, int cell)
+{
+  int k = session->given_at[cell];
+  return (k < 0) ? pset_empty() : session->given_color[k];
+}
+
+
+static void record (session_t *session, int cell, pset_t after)
+{
+  if (session->nedits == session->edits_size) {
+    session->edits_size = (session->edits_size == 0) ? 64
+                                                     : 2 * session->edits_size;
+    session->edits = realloc(session->edits,
+                             session->edits_size * sizeof(session_edit_t));
+    if (session->edits == NULL) {
+      fprintf(stderr,"sudoku: error: out of memory.\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  session_edit_t *edit = &session->edits[session->nedits];
+  edit->cell = cell;
+  edit->before = given_of(session, cell);
+  edit->after = after;
+  session->nedits++;
+}
+
+
+static void remove_given (session_t *session, int cell)
+{
+  int j = session->given_at[cell];
+
+  /* rewind to the given, the givens placed after it are undone too */
+  if (j < session->propagated) {
+    engine_undo(session->engine, session->given_mark[j]);
+    session->propagated = j;
+  }
+  for (int k = j + 1; k<session->givens; k++) {
+    session->given_cell[k - 1] = session->given_cell[k];
+    session->given_color[k - 1] = session->given_color[k];
+    session->given_at[session->given_cell[k]] = k - 1;
+  }
+  session->given_at[cell] = -1;
+  session->givens--;
+  session->solutions = -1;
+
+  /* replay the givens placed after it, or after a contradiction */
+  for (int k = session->propagated; k<session->givens; k++) {
+    propagate_given(session, k);
+  }
+}
+
+
+static void place_given (session_t *session, int cell, pset_t color)
+{
+  if (session->given_at[cell] >= 0) {
+    remove_given(session, cell);
+  }
+
+  int k = session->givens;
+  session->given_cell[k] = cell;
+  session->given_color[k] = color;
+  session->given_at[cell] = k;
+  session->givens++;
+  session->solutions = -1;
+  propagate_given(session, k);
+}
+
+
+bool session_place (session_t *session, int cell, int color)
+{
+  record(session, cell, pset_from_index(color));
+  place_given(session, cell, pset_from_index(color));
+  return session_consistent(session);
+}
+
+
+bool session_remove (session_t *session, int cell)
+{
+  if (session->given_at[cell] < 0) {
+    return false;
+  }
+  record(session, cell, pset_empty());
+  remove_given(session, cell);
+  return true;
+}
+
+
+bool session_undo (session_t *session)
+{
+  if (session->nedits == 0) {
+    return false;
+  }
+
+  session->nedits--;
+  const session_edit_t *edit = &session->edits[session->nedits];
+  if (pset_is_empty(edit->before)) {
+    remove_given(session, edit->cell);
+  } else {
+    place_given(session, edit->cell, edit->before);
+  }
+  return true;
+}
+
+
+bool session_consistent (const session_t *session)
+{
+  return session->base_consistent && session->propagated == session->givens;
+}
+
+
+static bool keep_solution (engine_t *engine, void *data)
+{
+  session_t *session = data;
+
+  if (engine->solutions == 1) {
+    memcpy(session->solution, engine->cells,
+           engine->ncells * sizeof(pset_t));
+  }
+  return true;
+}
+
+
+int session_solutions (session_t *session)
+{
+  engine_t *engine = session->engine;
+
+  if (session->solutions >= 0) {
+    return session->solutions;
+  }
+  if (!session_consistent(session)) {
+    session->solutions = 0;
+    return 0;
+  }
+
+  /* the search starts from the propagated grid and leaves it as it was */
+  size_t mark = engine->trail_len;
+  int result = engine_search(engine, 2, keep_solution, session);
+  /* a search stopped by the budget isn't kept */
+  session->solutions = (result == ENGINE_STOPPED) ? -1
+                                                  : (int) engine->solutions;
+  engine_rewind(engine, mark);
+  return session->solutions;
+}
+
+
+int session_hint (session_t *session, int *color, bool *forced)
+{
+  engine_t *engine = session->engine;
+  int chosen = -1;
+  size_t cardinality_chosen = MAX_COLORS + 1;
+
+  int solutions = session_solutions(session);
+
+  if (solutions == 0) {
+    return -1;
+  }
+
+  for (int cell = 0; cell<engine->ncells; cell++) {
+    if (session->given_at[cell] >= 0) {
+      continue;
+    }
+    size_t cardinality = pset_cardinality(engine->cells[cell]);
+    if (cardinality == 1) {
+      *color = pset_index(engine->cells[cell]);
+      *forced = true;
+      return cell;
+    }
+    if (cardinality < cardinality_chosen) {
+      chosen = cell;
+      cardinality_chosen = cardinality;
+    }
+  }
+
+  /* without a solution there is nothing to guess from */
+  if (chosen < 0 || solutions < 0) {
+    return -1;
+  }
+  *color = pset_index(session->solution[chosen]);
+  *forced = false;
+  return chosen;
+}
+
+
+const pset_t *session_cells (const session_t *session)
+{
+  return session->engine->cells;
+}
@@ -1,14 +1,32 @@
 #include "sudoku.h"
 
+#include <budget.h>
+#include <engine.h>
 #include <getopt.h>
+#include <lanes.h>
 #include <math.h>
+#include <metrics.h>
 #include <preemptive_set.h>	
+#include <pthread.h>
+#include <rating.h>
+#include <rng.h>
+#include <session.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
+#include <trace.h>
+#include <unistd.h>
+#include <verify.h>
 
 #define RATIO_GRID_SIZE 3
+#define MAX_SEARCH_CONSTRUCTION 16 /* bigger grids are built from a pattern */
+#define MAX_DUPLICATES 1000        /* generated in a row before giving up */
+#define UNKNOWN 3  /* grid_solver result when the budget ran out */
+#define CHECKPOINT_INTERVAL_S 60
+#define MAX_JOBS 1024
 
 static FILE *pFILEoutput;
 static FILE *pFILEinput;
@@ -17,21 +35,87 @@ static pset_t **grid;
 static bool verbose;
 static bool generate;
 static bool strict;
+static bool minimal;        /*remove the clues one at a time*/
+static int construction;    /*how the solution of a generated grid is built*/
+
+enum {CONSTRUCT_DEFAULT, CONSTRUCT_PATTERN, CONSTRUCT_SEARCH};
 static int grid_size;
 static int block_size;      /*will be the square root of grid_size*/
+static long timeout_ms;     /*0 means no time limit*/
+static uint64_t max_nodes;  /*0 means no node limit*/
+static budget_t budget;
+static bool count;          /*count the solutions instead of solving*/
+static bool enumerate;      /*print every solution*/
+static uint64_t count_limit;/*0 means count all the solutions*/
+static int jobs;            /*number of threads for counting*/
+static uint64_t seed;       /*first seed of the generators*/
+static bool batch;          /*the input file has several grids*/
+static bool scalar;         /*no SIMD lanes for batches, no bitboards*/
+static bool tokens;         /*cells are numbers separated by blanks*/
+static bool verify;         /*check the solutions of the input file*/
+static bool solved_only;    /*they are solved grids, without puzzles*/
+static bool rate;           /*rate the grids of the input file*/
+static bool grading;        /*generate grids graded in a band*/
+static bool interactive;    /*edit the grid with commands read on stdin*/
+static double grade_low;
+static double grade_high;
+static char *metrics_path;  /*NULL means no metrics*/
+static long metrics_interval_ms;
+static metrics_t *metrics;
+static char *checkpoint_path;     /*NULL means no checkpoints*/
+static long checkpoint_interval_s;/*0 means only on signals*/
+static char *resume_path;         /*NULL means a new search*/
+static engine_t *resumed;         /*the search read from resume_path*/
+static uint64_t resumed_nodes;
+static engine_t *volatile searching;/*the search to checkpoint*/
+static volatile sig_atomic_t stop_requested;
+static char *trace_path;          /*NULL means no trace*/
+static uint64_t trace_sample;
+static trace_t *trace;
 
 static void usage (int status)
 {
   if (status == EXIT_SUCCESS) {
     printf(
       "Usage: %s [OPTIONS] FILE...\n"
-      "Solve sudoku puzzle's of variable sizes (1-4-9-16-25-36-48-64).\n\n"
+      "Solve sudoku puzzle's of variable sizes (1-4-9-16-25-36-48-64, and up "
+      "to %d\nwith tokens).\n\n"
       "-oFILE,\t --output=FILE\t\twrite result to FILE\n"
       "-gSIZE,\t --generate=SIZE\tgenerate a SIZE-sized grid (9 by default).\n"
       "-s,\t --strict\t\tto have only one solution\n"
+      "-m,\t --minimal\t\tonly one solution and no removable clue\n"
+      "-kMODE,\t --construct=MODE\tbuild the generated solution from a "
+      "'pattern'\n\t\t\t\tor by a randomized 'search'\n"
+      "-tMS,\t --timeout=MS\t\tgive up the search after MS milliseconds\n"
+      "-nN,\t --max-nodes=N\t\tgive up the search after N nodes\n"
+      "-c[N],\t --count[=N]\t\tcount the solutions (stop at N)\n"
+      "-e,\t --enumerate\t\tprint every solution as it is found\n"
+      "-jJ,\t --jobs=J\t\tcount, enumerate or generate with J threads\n"
+      "-rS,\t --seed=S\t\tseed of the generated grids\n"
+      "-b,\t --batch\t\tsolve every grid of FILE, one after the other\n"
+      "-S,\t --scalar\t\tsolve without SIMD lanes nor bitboards\n"
+      "-T,\t --tokens\t\tcells are numbers separated by blanks\n"
+      "-y,\t --verify\t\tcheck the solved grids (each one after its "
+      "puzzle)\n"
+      "-Y,\t --verify-solved\tcheck the solved grids (no puzzle)\n"
+      "-d,\t --rate\t\t\trate the difficulty of the grids\n"
+      "-GLO:HI, --grade=LO:HI\tgenerate grids graded from LO to HI\n"
+      "-u,\t --session\t\tedit the grid with commands read on the "
+      "standard input\n"
+      "-MFILE,\t --metrics=FILE\t\twrite metrics to FILE while running\n"
+      "-IMS,\t --metrics-interval=MS\twrite the metrics every MS "
+      "milliseconds\n"
+      "-KFILE,\t --checkpoint=FILE\tsave the search to FILE from time to "
+      "time\n"
+      "-pS,\t --checkpoint-interval=S\tsave it every S seconds (0 for "
+      "signals only)\n"
+      "-RFILE,\t --resume=FILE\t\tgo on with the search saved in FILE\n"
+      "-XFILE,\t --trace=FILE\t\twrite the events of the search to FILE\n"
+      "-xN,\t --trace-sample=N\ttrace one node of the search in N\n"
+      "With -g, -cN (--count=N) generates N different grids.\n"
       "-v,\t --verbose\t\tverbose output\n"
       "-V,\t --version\t\tdisplay version and exit\n"
-      "-h,\t --help\t\t\tdisplay this help\n\n", progName);
+      "-h,\t --help\t\t\tdisplay this help\n\n", progName, MAX_COLORS);
     exit(EXIT_SUCCESS);
   }
   else {
@@ -48,14 +132,75 @@ static void version(char *argv[])
 }
 
 
+/* we use strtoll instead of atoi to avoid input like 15fefe*/
+static long long parse_number (char *arg)
+{
+  char *test_function = {'\0'};
+  long long res = strtoll(arg, &test_function, 0);
+  if (test_function[0] != '\0' || arg[0] == '\0' || res < 0) {
+    fprintf(stderr,"sudoku: error: not a positive number -- '%s'\n", arg);
+    usage(EXIT_FAILURE);
+  }
+  return res;
+}
+
+
+/* getopt only takes an optional argument glued to its option (-g16 or
+   --generate=16) : this also accepts it as the next word (-g 16) */
+static char *optional_value (int argc, char *argv[])
+{
+  if (optarg == NULL && optind < argc &&
+      argv[optind][0] >= '0' && argv[optind][0] <= '9') {
+    char *end;
+    strtoll(argv[optind], &end, 0);
+    /* a word which isn't only a number is a file (-c 1grid.txt) */
+    if (*end == '\0') {
+      optind++;
+      return argv[optind - 1];
+    }
+  }
+  return optarg;
+}
+
+
 static void check_options (int argc, char *argv[])
 {
   /*verbose, generate, strict and pFILEoutput have initial values.
     they can be change by options.*/
   generate = false;
   strict = false;
+  minimal = false;
+  construction = CONSTRUCT_DEFAULT;
   verbose = false;
+  timeout_ms = 0;
+  max_nodes = 0;
+  count = false;
+  enumerate = false;
+  count_limit = 0;
+  jobs = 1;
+  batch = false;
+  scalar = false;
+  tokens = false;
+  verify = false;
+  solved_only = false;
+  rate = false;
+  grading = false;
+  interactive = false;
+  metrics_path = NULL;
+  metrics_interval_ms = METRICS_INTERVAL_MS;
+  checkpoint_path = NULL;
+  checkpoint_interval_s = CHECKPOINT_INTERVAL_S;
+  resume_path = NULL;
+  trace_path = NULL;
+  trace_sample = 1;
   pFILEoutput = stdout;
+
+  /* two runs in the same second must not give the same grids */
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  seed = ((uint64_t)now.tv_sec * 1000000000 + now.tv_nsec) ^
+         ((uint64_t)getpid() << 32);
+
   struct option long_opts[] = {
     {"help",  	0, NULL, 'h'}, /* 0 means no arguments */
     {"verbose",	0, NULL, 'v'}, /* 0 means no arguments */
@@ -63,11 +208,34 @@ static void check_options (int argc, char *argv[])
     {"output",	1, NULL, 'o'}, /* 1 means an argument is requiered */
     {"generate",2, NULL, 'g'}, /* 2 means an argument is optional */
     {"strict",	0, NULL, 's'}, /* 0 means no arguments */
+    {"minimal",	0, NULL, 'm'}, /* 0 means no arguments */
+    {"construct",1, NULL, 'k'}, /* 1 means an argument is requiered */
+    {"timeout",	1, NULL, 't'}, /* 1 means an argument is requiered */
+    {"max-nodes",1, NULL, 'n'}, /* 1 means an argument is requiered */
+    {"count",	2, NULL, 'c'}, /* 2 means an argument is optional */
+    {"enumerate",0, NULL, 'e'}, /* 0 means no arguments */
+    {"jobs",	1, NULL, 'j'}, /* 1 means an argument is requiered */
+    {"seed",	1, NULL, 'r'}, /* 1 means an argument is requiered */
+    {"batch",	0, NULL, 'b'}, /* 0 means no arguments */
+    {"scalar",	0, NULL, 'S'}, /* 0 means no arguments */
+    {"tokens",	0, NULL, 'T'}, /* 0 means no arguments */
+    {"verify",	0, NULL, 'y'}, /* 0 means no arguments */
+    {"verify-solved",0, NULL, 'Y'}, /* 0 means no arguments */
+    {"rate",	0, NULL, 'd'}, /* 0 means no arguments */
+    {"grade",	1, NULL, 'G'}, /* 1 means an argument is requiered */
+    {"session",	0, NULL, 'u'}, /* 0 means no arguments */
+    {"metrics",	1, NULL, 'M'}, /* 1 means an argument is requiered */
+    {"metrics-interval",1, NULL, 'I'}, /* 1 means an argument is requiered */
+    {"checkpoint",1, NULL, 'K'}, /* 1 means an argument is requiered */
+    {"checkpoint-interval",1, NULL, 'p'}, /* 1 means an argument is requiered */
+    {"resume",	1, NULL, 'R'}, /* 1 means an argument is requiered */
+    {"trace",	1, NULL, 'X'}, /* 1 means an argument is requiered */
+    {"trace-sample",1, NULL, 'x'}, /* 1 means an argument is requiered */
     {NULL,			0, NULL, 0  }  /* this line i required. */
   };
   
   int optc;
-  while ((optc=getopt_long (argc, argv, "hvVo:g::s", long_opts, NULL)) != -1) {
+  while ((optc=getopt_long (argc, argv, "hvVo:g::smk:t:n:c::ej:r:bSTyYduG:M:I:K:p:R:X:x:", long_opts, NULL)) != -1) {
     switch (optc) {
       case 'h' :
         usage(EXIT_SUCCESS);
@@ -82,6 +250,7 @@ static void check_options (int argc, char *argv[])
       case 'g' :
       
         generate = true;
+        optarg = optional_value(argc, argv);
         if (optarg == NULL) {
           grid_size = 9;
         } else {
@@ -95,11 +264,17 @@ static void check_options (int argc, char *argv[])
             usage(EXIT_FAILURE);
           }
           
-          if (grid_size!=1 && grid_size!=4 && grid_size!=9 && grid_size!=16 && 
-              grid_size!=25 && grid_size!=36 && grid_size!=49 && grid_size!=64){
+          int block = sqrt(grid_size);
+          if (grid_size < 1 || block * block != grid_size) {
             fprintf(stderr,"sudoku: error: wrong size -- '%d'\n", grid_size);
             usage(EXIT_FAILURE);
           }
+          if (grid_size > MAX_COLORS) {
+            fprintf(stderr,"sudoku: error: sizes above %d need a build with "
+                           "more words by set (make PSET_WORDS=%d)\n",
+                    MAX_COLORS, (grid_size + 63) / 64 > 2 ? 4 : 2);
+            usage(EXIT_FAILURE);
+          }
         }
         
         block_size = sqrt(grid_size);
@@ -115,6 +290,126 @@ static void check_options (int argc, char *argv[])
           strict = true;
         }
         break;
+      case 'm' :
+        if (!generate) {
+          fprintf(stderr,"sudoku: error: can't call -m without -g.\n"
+                         "try to put -g before -m.\n");
+          usage(EXIT_FAILURE);
+        }
+        strict = true;
+        minimal = true;
+        break;
+      case 'k' :
+        if (strcmp(optarg, "pattern") == 0) {
+          construction = CONSTRUCT_PATTERN;
+        } else if (strcmp(optarg, "search") == 0) {
+          construction = CONSTRUCT_SEARCH;
+        } else {
+          fprintf(stderr,"sudoku: error: unknown construction -- '%s'\n",
+                  optarg);
+          usage(EXIT_FAILURE);
+        }
+        break;
+      case 't' :
+        timeout_ms = parse_number(optarg);
+        break;
+      case 'n' :
+        max_nodes = parse_number(optarg);
+        break;
+      case 'c' :
+        count = true;
+        optarg = optional_value(argc, argv);
+        if (optarg != NULL) {
+          count_limit = parse_number(optarg);
+        }
+        break;
+      case 'e' :
+        enumerate = true;
+        break;
+      case 'j' : {
+        long long wanted = parse_number(optarg);
+        if (wanted < 1 || wanted > MAX_JOBS) {
+          fprintf(stderr,"sudoku: error: from 1 to %d jobs are allowed.\n",
+                  MAX_JOBS);
+          usage(EXIT_FAILURE);
+        }
+        jobs = wanted;
+        break;
+      }
+      case 'r' :
+        seed = parse_number(optarg);
+        break;
+      case 'b' :
+        batch = true;
+        break;
+      case 'S' :
+        scalar = true;
+        break;
+      case 'T' :
+        tokens = true;
+        break;
+      case 'y' :
+        verify = true;
+        break;
+      case 'Y' :
+        verify = true;
+        solved_only = true;
+        break;
+      case 'd' :
+        rate = true;
+        break;
+      case 'u' :
+        interactive = true;
+        break;
+      case 'G' : {
+        /* LO:HI, or LO for no upper grade */
+        char *end;
+        grading = true;
+        strict = true;
+        grade_low = strtod(optarg, &end);
+        grade_high = RATING_NO_CEILING;
+        if (*end == ':') {
+          grade_high = strtod(end + 1, &end);
+        }
+        if (end == optarg || *end != '\0' || grade_low < 0 ||
+            grade_high < grade_low) {
+          fprintf(stderr,"sudoku: error: not a grade band -- '%s'\n",
+                  optarg);
+          usage(EXIT_FAILURE);
+        }
+        break;
+      }
+      case 'M' :
+        metrics_path = optarg;
+        break;
+      case 'I' :
+        metrics_interval_ms = parse_number(optarg);
+        if (metrics_interval_ms < 1) {
+          fprintf(stderr,"sudoku: error: the metrics interval must be at "
+                         "least 1 ms.\n");
+          usage(EXIT_FAILURE);
+        }
+        break;
+      case 'K' :
+        checkpoint_path = optarg;
+        break;
+      case 'p' :
+        checkpoint_interval_s = parse_number(optarg);
+        break;
+      case 'R' :
+        resume_path = optarg;
+        break;
+      case 'X' :
+        trace_path = optarg;
+        break;
+      case 'x' :
+        trace_sample = parse_number(optarg);
+        if (trace_sample < 1) {
+          fprintf(stderr,"sudoku: error: at least one node in 1 must be "
+                         "traced.\n");
+          usage(EXIT_FAILURE);
+        }
+        break;
       case 'v' :
         verbose = true;
         break;
@@ -126,9 +421,49 @@ static void check_options (int argc, char *argv[])
     }
   }
   
+  if (resume_path != NULL) {
+    if (generate || batch || verify || rate || argc > optind) {
+      fprintf(stderr,"sudoku: error: a resumed search can't be used with "
+                     "-g, -b or a grid.\n");
+      usage(EXIT_FAILURE);
+    }
+    /* the search goes on being saved where it was saved */
+    if (checkpoint_path == NULL) {
+      checkpoint_path = resume_path;
+    }
+  }
+  if (interactive &&
+      (generate || batch || verify || rate || resume_path != NULL ||
+       checkpoint_path != NULL || count || enumerate)) {
+    fprintf(stderr,"sudoku: error: a session only edits one grid, it can't "
+                   "be used with -g, -b, -y, -d, -c, -e, -K or -R.\n");
+    usage(EXIT_FAILURE);
+  }
+  if (trace_path != NULL && jobs > 1) {
+    fprintf(stderr,"sudoku: error: only a search with one job can be "
+                   "traced.\n");
+    usage(EXIT_FAILURE);
+  }
+  if (checkpoint_path != NULL &&
+      (generate || batch || verify || rate || jobs > 1)) {
+    fprintf(stderr,"sudoku: error: only the search of one grid by one job "
+                   "can be saved.\n");
+    usage(EXIT_FAILURE);
+  }
+
   /*verifying the user put a correct argument
     it allowed only one supply argument for file name*/
-  if (!generate) {
+  if (grading && !generate) {
+    fprintf(stderr,"sudoku: error: can't call -G without -g.\n");
+    usage(EXIT_FAILURE);
+  }
+  if (resume_path != NULL) {
+    pFILEinput=fopen(resume_path, "r");
+    if (pFILEinput==NULL) {
+      fprintf(stderr,"sudoku: error: checkpoint openning error.\n");
+      usage(EXIT_FAILURE);
+    }
+  } else if (!generate) {
     if (argc < optind +1) {
       fprintf(stderr,"sudoku: error: file name missing.\n");
       /* we don't care the case the file name has two words*/
@@ -145,6 +480,13 @@ static void check_options (int argc, char *argv[])
   } else if (argc > optind) {
     fprintf(stderr,"sudoku: error: can't generate and load a grid.\n");
     usage(EXIT_FAILURE);
+  } else if (batch || verify || rate) {
+    fprintf(stderr,"sudoku: error: can't generate and solve a batch.\n");
+    usage(EXIT_FAILURE);
+  } else if (enumerate) {
+    fprintf(stderr,"sudoku: error: can't enumerate the solutions of a "
+                   "generated grid.\n");
+    usage(EXIT_FAILURE);
   }
 }
 
@@ -240,7 +582,10 @@ static pset_t filter_full_pset (char c)
 }
 
 
-static void grid_parser(FILE *file)
+/* Read a grid from file into grid. In batch mode, the reading stops at the
+   end of the grid so that the next call reads the next one, and false is
+   returned when there is no grid left. */
+static bool grid_parser(FILE *file, bool batch)
 {
   int current_line = 0;
   int current_row = 0;
@@ -267,6 +612,10 @@ static void grid_parser(FILE *file)
             if (!reading_started) {
               reading_started = true;
             }
+            if (grid_size == MAX_COLORS) {
+              fprintf(stderr,"sudoku: error: too many cells in line 0.\n");
+              usage(EXIT_FAILURE);
+            }
             first_line[grid_size] = current_char;
             grid_size++;
           }
@@ -289,6 +638,9 @@ static void grid_parser(FILE *file)
             if (current_row >= grid_size) {
               current_row=0;
               current_line++;
+              if (batch && current_line == grid_size) {
+                return true;
+              }
             }
           }
         }/* so, current_char is \n   <-(this is not useless for me) */
@@ -315,6 +667,9 @@ static void grid_parser(FILE *file)
           }
           
           current_line = 1;
+          if (batch && current_line == grid_size) {
+            return true;
+          }
         }
         
         else if (current_row != 0) {
@@ -326,6 +681,9 @@ static void grid_parser(FILE *file)
   }
 
   if (!reading_started){
+    if (batch) {
+      return false;
+    }
     fprintf(stderr,"sudoku: error: there is no grid.\n");
     usage(EXIT_FAILURE);
   }
@@ -333,29 +691,187 @@ static void grid_parser(FILE *file)
     fprintf(stderr,"sudoku: error: too few lines in the grid.\n");
     usage(EXIT_FAILURE);
   }
+  return true;
 }
 
 
-static void grid_print(pset_t **grid)
+/* Read a token of a grid written with tokens : '_' for any color, or the
+   numbers (from 1) of the colors separated by commas. Return the empty set
+   if the token is wrong. */
+static pset_t token2pset (const char *token)
 {
-  for (int j = 0; j<grid_size; j++) {
+  if (strcmp(token, "_") == 0) {
+    return pset_full(grid_size);
+  }
+
+  pset_t res = pset_empty();
+  while (*token != '\0') {
+    char *end;
+    long color = strtol(token, &end, 10);
+    if (end == token || color < 1 || color > grid_size ||
+        (*end != ',' && *end != '\0')) {
+      return pset_empty();
+    }
+    res = pset_or(res, pset_from_index(color - 1));
+    token = (*end == ',') ? end + 1 : end;
+  }
+  return res;
+}
+
+
+/* Same as grid_parser for a grid written with tokens, one line of the grid
+   per line of the file, the cells being separated by blanks. This is how
+   grids with more colors than characters are written. */
+static bool grid_parser_tokens(FILE *file, bool batch)
+{
+  char *line = NULL;
+  size_t capacity = 0;
+  int current_line = 0;
+  char *cells[MAX_COLORS + 1];
+
+  grid_size = 0;
+  while (getline(&line, &capacity, file) != -1) {
+    char *comment = strchr(line, '#');
+    if (comment != NULL) {
+      *comment = '\0';
+    }
+
+    int ncells = 0;
+    for (char *cell = strtok(line, " \t\r\n"); cell != NULL;
+         cell = strtok(NULL, " \t\r\n")) {
+      if (ncells == MAX_COLORS) {
+        fprintf(stderr,"sudoku: error: too many cells in line %d.\n",
+                current_line);
+        usage(EXIT_FAILURE);
+      }
+      cells[ncells] = cell;
+      ncells++;
+    }
+    if (ncells == 0) {
+      continue;
+    }
+
+    if (current_line == 0) {
+      grid_size = ncells;
+      block_size = sqrt(grid_size);
+      if (block_size * block_size != grid_size) {
+        fprintf(stderr,"sudoku: error: wrong size -- '%d'\n", grid_size);
+        usage(EXIT_FAILURE);
+      }
+      grid = grid_alloc();
+    } else if (current_line == grid_size) {
+      fprintf(stderr,"sudoku: error: too many lines in the grid.\n");
+      usage(EXIT_FAILURE);
+    } else if (ncells != grid_size) {
+      fprintf(stderr,"sudoku: error: not a right number of cells in "
+                     "line %d.\n", current_line);
+      usage(EXIT_FAILURE);
+    }
+
     for (int i = 0; i<grid_size; i++) {
-      if (grid[j][i] == 0) {
-        fprintf(pFILEoutput, "??\t");       
-       } else if (grid[j][i] == pset_full(grid_size)) {
-        fprintf(pFILEoutput, "_\t");       
-       } else {
-        char str[MAX_COLORS+1];
-        pset2str(str, grid[j][i]);
-        fprintf(pFILEoutput, "%s\t",str);
+      grid[current_line][i] = token2pset(cells[i]);
+      if (pset_is_empty(grid[current_line][i])) {
+        fprintf(stderr,"sudoku: error: wrong cell %s at line %d.\n",
+                cells[i], current_line);
+        usage(EXIT_FAILURE);
       }
     }
-    fprintf(pFILEoutput, "\n");
+
+    current_line++;
+    if (batch && current_line == grid_size) {
+      free(line);
+      return true;
+    }
+  }
+  free(line);
+
+  if (current_line == 0) {
+    if (batch) {
+      return false;
+    }
+    fprintf(stderr,"sudoku: error: there is no grid.\n");
+    usage(EXIT_FAILURE);
+  }
+  else if (current_line <grid_size) {
+    fprintf(stderr,"sudoku: error: too few lines in the grid.\n");
+    usage(EXIT_FAILURE);
+  }
+  return true;
+}
+
+
+static bool grid_read(FILE *file, bool batch)
+{
+  if (tokens) {
+    return grid_parser_tokens(file, batch);
+  }
+  return grid_parser(file, batch);
+}
+
+
+/* print the numbers of the colors of pset, separated by commas */
+static void token_print(pset_t pset)
+{
+  const char *separator = "";
+
+  while (!pset_is_empty(pset)) {
+    pset_t color = pset_leftmost(pset);
+    pset = pset_discard2(pset, color);
+    fprintf(pFILEoutput, "%s%d", separator, pset_index(color) + 1);
+    separator = ",";
+  }
+}
+
+
+static void line_print(const pset_t *line)
+{
+  for (int i = 0; i<grid_size; i++) {
+    if (pset_is_empty(line[i])) {
+      fprintf(pFILEoutput, "??\t");       
+     } else if (pset_equal(line[i], pset_full(grid_size))) {
+      fprintf(pFILEoutput, "_\t");       
+     } else if (tokens || grid_size > CHAR_COLORS) {
+      token_print(line[i]);
+      fprintf(pFILEoutput, "\t");
+     } else {
+      char str[MAX_COLORS+1];
+      pset2str(str, line[i]);
+      fprintf(pFILEoutput, "%s\t",str);
+    }
+  }
+  fprintf(pFILEoutput, "\n");
+}
+
+
+static void grid_print(pset_t **grid)
+{
+  for (int j = 0; j<grid_size; j++) {
+    line_print(grid[j]);
+  }
+  fprintf(pFILEoutput, "\n");
+}
+
+
+/* same as grid_print for a flat grid (cell = line * grid_size + row) */
+static void cells_print(const pset_t *cells)
+{
+  for (int j = 0; j<grid_size; j++) {
+    line_print(cells + j * grid_size);
   }
   fprintf(pFILEoutput, "\n");
 }
 
 
+static void grid_flatten(pset_t **grid, pset_t *cells)
+{
+  for (int j = 0; j<grid_size; j++) {
+    for (int i = 0; i<grid_size; i++) {
+      cells[j * grid_size + i] = grid[j][i];
+    }
+  }
+}
+
+
 /* return true if the grid is solved, false otherwise. */
 static bool grid_solved(pset_t **grid)
 {
@@ -371,13 +887,14 @@ static bool grid_solved(pset_t **grid)
 
 
 static void scan_block (int starting_column, int starting_row,
-                         pset_t *subgrid[], pset_t **grid)
+                         pset_t *subgrid[], int cells[], pset_t **grid)
 {
   int current_position_subgrid = 0;  
   
   for (int j = starting_column; j < (starting_column+block_size); j++) {
     for (int i = starting_row; i < (starting_row+block_size); i++) {
       subgrid[current_position_subgrid] = &grid[j][i];
+      cells[current_position_subgrid] = j * grid_size + i;
       current_position_subgrid++;
     }
   }
@@ -386,9 +903,12 @@ static void scan_block (int starting_column, int starting_row,
 
 /* This function get a grid, apply func to each subgrid and return false if
    func returned at least once false. True else.*/
-static bool subgrid_map (pset_t **grid, bool (*func) (pset_t *subgrid[]))
+/* func gets the cells of a subgrid and their numbers (for the trace) */
+static bool subgrid_map (pset_t **grid,
+                         bool (*func) (pset_t *subgrid[], const int cells[]))
 {
   pset_t *subgrid[grid_size];
+  int cells[grid_size];
   bool fixpoint = true; 
   
   /* scanning all rows : */
@@ -396,9 +916,10 @@ static bool subgrid_map (pset_t **grid, bool (*func) (pset_t *subgrid[]))
     int current_position_grid = 0;
     for (int i = 0; i<grid_size; i++) {
       subgrid[current_position_grid] = &grid[j][i];
+      cells[current_position_grid] = j * grid_size + i;
       current_position_grid++;
     }
-    if (!func(subgrid)) {
+    if (!func(subgrid, cells)) {
       fixpoint = false;
     }
   }
@@ -408,9 +929,10 @@ static bool subgrid_map (pset_t **grid, bool (*func) (pset_t *subgrid[]))
     int current_position_grid = 0;
     for (int j = 0; j<grid_size; j++) {
       subgrid[current_position_grid] = &grid[j][i];
+      cells[current_position_grid] = j * grid_size + i;
       current_position_grid++;
     }
-    if (!func(subgrid)) {
+    if (!func(subgrid, cells)) {
       fixpoint = false;
     }
   }
@@ -418,8 +940,8 @@ static bool subgrid_map (pset_t **grid, bool (*func) (pset_t *subgrid[]))
   /* scanning all blocks : */
   for (int j = 0; j<grid_size; j+=block_size) {
     for (int i = 0; i<grid_size; i+=block_size) {
-      scan_block (j,i, subgrid, grid);
-      if (!func(subgrid)) {
+      scan_block (j,i, subgrid, cells, grid);
+      if (!func(subgrid, cells)) {
         fixpoint = false;
       }
     }
@@ -432,8 +954,9 @@ static bool subgrid_map (pset_t **grid, bool (*func) (pset_t *subgrid[]))
 /* with a subgrid in input, it returns false if one of the three conditions is 
    violated : one color by subgrid ; each color present on each subgrid ;
    one color is empty */
-static bool subgrid_consistency(pset_t *subgrid[])
+static bool subgrid_consistency(pset_t *subgrid[], const int cells[])
 {
+  (void) cells;
   pset_t final_pset = pset_empty();
   pset_t singleton_pset = pset_empty();  
     
@@ -444,7 +967,7 @@ static bool subgrid_consistency(pset_t *subgrid[])
         
     if (pset_is_singleton (*subgrid[i])) {
     /* that negation means that subgrid[i] was already in singleton_pset.*/
-      if (pset_and(singleton_pset, *subgrid[i]) != pset_empty()) {
+      if (!pset_is_empty(pset_and(singleton_pset, *subgrid[i]))) {
         return false;
       } else {
         singleton_pset = pset_or (singleton_pset, *subgrid[i]);
@@ -452,14 +975,15 @@ static bool subgrid_consistency(pset_t *subgrid[])
     }
   }
   
-  return (final_pset == pset_full (grid_size));
+  return pset_equal(final_pset, pset_full (grid_size));
 }
 
 
 /* will apply cross-hatching to subgrid and return true if a changement has 
    occured, false else.
    if a cell is a singleton, remove all the similar color to the subgrid*/
-static bool subgrid_heuristics_cross_hatching(pset_t *subgrid[])
+static bool subgrid_heuristics_cross_hatching(pset_t *subgrid[],
+                                              const int cells[])
 {
   bool fixpoint = false;
   
@@ -470,8 +994,13 @@ static bool subgrid_heuristics_cross_hatching(pset_t *subgrid[])
         /*the second part of the next condition is to not modify the pset if
           we don't need to*/
         if (j!=i && pset_is_included(*subgrid[i],*subgrid[j])) {
+          pset_t old = *subgrid[j];
           *subgrid[j] = pset_discard2(*subgrid[j], *subgrid[i]);
           fixpoint = true;
+          if (TRACE_ON(trace)) {
+            trace_change(trace, TRACE_CROSS_HATCHING, trace->depth, cells[j],
+                         old, *subgrid[j]);
+          }
         }
       }
 
@@ -485,7 +1014,8 @@ static bool subgrid_heuristics_cross_hatching(pset_t *subgrid[])
 /* will apply lone number to subgrid and return true if a changement has 
    occured, false else.
    if a color occurs only once in a subgrid, it becomes a singleton*/
-static bool subgrid_heuristics_lone_number(pset_t *subgrid[])
+static bool subgrid_heuristics_lone_number(pset_t *subgrid[],
+                                           const int cells[])
 {
   bool fixpoint = false;
   
@@ -500,6 +1030,10 @@ static bool subgrid_heuristics_lone_number(pset_t *subgrid[])
     }
     
     if (pset_is_singleton(temp)) {
+      if (TRACE_ON(trace) && !pset_equal(temp, *subgrid[i])) {
+        trace_change(trace, TRACE_LONE_NUMBER, trace->depth, cells[i],
+                     *subgrid[i], temp);
+      }
       *subgrid[i] = temp;
       fixpoint = true;
     }
@@ -528,16 +1062,18 @@ static int grid_heuristics (pset_t **grid)
     fixpoint = true;
 
     fixpoint = !(subgrid_heuristics (grid));
-
-    if (verbose && !generate) {
-      grid_print(grid);
-    }
   }
   
- if (grid_solved(grid)) {
-    return 0;
-  } else if (!subgrid_map (grid, subgrid_consistency)) {
+  /* a grid of singletons may still have twice the same color in a subgrid,
+     so consistency has to be checked first */
+  if (!subgrid_map (grid, subgrid_consistency)) {
+    if (TRACE_ON(trace)) {
+      trace_event(trace, TRACE_CONTRADICTION, TRACE_NO_RULE, trace->depth,
+                  -1, -1, 0);
+    }
     return 2;
+  } else if (grid_solved(grid)) {
+    return 0;
   } else {
     return 1;
   }
@@ -566,15 +1102,29 @@ static pset_t **grid_copy (pset_t **grid) {
    until we know if the grid is not consistency or it's solved.
    Depth-first traversal method is used.
    Will Return 1 if it's solved with only one solution, 2 if it's solved with*
-   more than 1 solution and 0 if it's not consistent.
+   more than 1 solution, 0 if it's not consistent and UNKNOWN if the budget
+   ran out before we knew.
    using the global grid once it's resolved avoid to copy many times the grid.
    */
-static int grid_solver (pset_t **grid)
+static int grid_solver (pset_t **grid, budget_t *budget)
 {
   int result = 0;
+
+  /* each call is a node of the search tree */
+  if (budget_tick(budget)) {
+    return UNKNOWN;
+  }
+  if (trace != NULL) {
+    trace_node(trace);
+  }
+
   int result_heuristic = grid_heuristics (grid);
 
   if (result_heuristic == 0) {
+    if (TRACE_ON(trace)) {
+      trace_event(trace, TRACE_SOLUTION, TRACE_NO_RULE, trace->depth, -1, -1,
+                  0);
+    }
     return 1;
   } else if (result_heuristic == 2) {
     return 0;
@@ -607,7 +1157,7 @@ static int grid_solver (pset_t **grid)
     pset_t **reference_grid = grid_copy(grid);
     
     /*for each letter in the chosen cell : */
-    while (chosen_cell != pset_empty()) {
+    while (!pset_is_empty(chosen_cell)) {
 
       /* we copy the grid and place in it one of the element of chosen cell*/
       pset_t left_most_element = pset_leftmost(chosen_cell);
@@ -617,7 +1167,30 @@ static int grid_solver (pset_t **grid)
       chosen_cell =  pset_discard2 (chosen_cell, left_most_element);
       
       /*recursive call*/
-      int temp = grid_solver(temporary_grid);
+      int cell = x_chosen_cell * grid_size + y_chosen_cell;
+      if (TRACE_ON(trace)) {
+        trace_event(trace, TRACE_BRANCH, TRACE_CHOICE, trace->depth, cell,
+                    pset_index(left_most_element),
+                    pset_cardinality(chosen_cell));
+      }
+      if (trace != NULL) {
+        trace->depth++;
+      }
+      int temp = grid_solver(temporary_grid, budget);
+      if (trace != NULL) {
+        trace->depth--;
+        if (TRACE_ON(trace)) {
+          trace_event(trace, TRACE_BACKTRACK, TRACE_CHOICE, trace->depth + 1,
+                      cell, pset_index(left_most_element),
+                      pset_cardinality(chosen_cell));
+        }
+      }
+
+      if (temp == UNKNOWN) {
+        grid_free(temporary_grid);
+        grid_free(reference_grid);
+        return UNKNOWN;
+      }
 
       result += temp;
       if (temp>0) {
@@ -640,62 +1213,256 @@ static int grid_solver (pset_t **grid)
 }
 
 
-static void remove_random_cell (pset_t **grid)
+/* return the removed cell (line * grid_size + row) */
+static int remove_random_cell (pset_t **grid, rng_t *rng)
 {
   int x_generated;
   int y_generated;
 
   do {
-    x_generated = rand() % grid_size;
-    y_generated = rand() % grid_size;
+    x_generated = rng_below(rng, grid_size);
+    y_generated = rng_below(rng, grid_size);
     /*this while can't loop ifinitely cause number_generated is less than 
       the number of cases in the grid */
 
-  } while (grid[y_generated][x_generated] == pset_full(grid_size));
+  } while (pset_equal(grid[y_generated][x_generated],
+                      pset_full(grid_size)));
   
   grid[y_generated][x_generated] = pset_full(grid_size);
+  return y_generated * grid_size + x_generated;
+}
+
+
+static void place_a_singleton (pset_t **grid, rng_t *rng)
+{
+  int x_generated = rng_below(rng, grid_size);
+  int y_generated = rng_below(rng, grid_size);
+  int z_generated = rng_below(rng, grid_size);
+  grid[y_generated][x_generated] = pset_from_index(z_generated);
+}
+
+
+static void budget_exceeded_in_generation (void)
+{
+  fprintf(stderr,"sudoku: error: generation stopped, budget exceeded.\n");
+  exit(EXIT_FAILURE);
 }
 
 
-static void place_a_singleton (pset_t **grid)
+/* grid had only one solution before the cells of removed were emptied.
+   Any other solution of grid must differ from solution on one of these
+   cells, so we only have to prove that none of them can take another color:
+   that is one search for a first solution per removed cell, which usually
+   fails by propagation alone. */
+static bool only_one_solution (engine_t *engine, pset_t **grid,
+                               const pset_t *solution,
+                               const int *removed, int nremoved)
 {
-  int x_generated = rand() % grid_size;
-  int y_generated = rand() % grid_size;
-  int z_generated = rand() % grid_size;
-  pset_t pset = 1;
-  for(int i = 0; i<z_generated; i++) {
-    pset=pset<<1;
+  grid_flatten(grid, engine->cells);
+  engine_load(engine, engine->cells);
+  if (!engine_propagate(engine)) {
+    return false;
+  }
+  size_t mark = engine->trail_len;
+
+  for (int i = 0; i<nremoved; i++) {
+    int result = ENGINE_DONE;
+    if (engine_restrict(engine, removed[i],
+                        pset_negate(solution[removed[i]]))) {
+      result = engine_search(engine, 1, NULL, NULL);
+    }
+    engine_rewind(engine, mark);
+
+    if (result == ENGINE_STOPPED) {
+      budget_exceeded_in_generation();
+    } else if (result == ENGINE_LIMIT) {
+      return false;
+    }
   }
-  grid[y_generated][x_generated] = pset;
+  return true;
 }
 
 
-static bool only_one_solution (pset_t **grid)
+/* Fisher-Yates shuffle */
+static void shuffle (int *array, int length, rng_t *rng)
 {
-  pset_t **temporary_grid = grid_copy(grid);
-  int result = grid_solver(temporary_grid);
-  grid_free(temporary_grid);  
-  return (result==1);
+  for (int i = length - 1; i>0; i--) {
+    int other = rng_below(rng, i + 1);
+    int temp = array[i];
+    array[i] = array[other];
+    array[other] = temp;
+  }
 }
 
 
-static void generate_grid (void)
+/* Fill grid with the pattern solution (block * (line % block) + line / block
+   + row) % grid_size, after applying to it random transformations which keep
+   a grid valid : relabelling the colors, permuting the bands (groups of
+   block lines), the lines inside each band, the stacks (groups of block
+   rows), the rows inside each stack, and transposing.
+   It takes a time linear in the number of cells, whatever the size. */
+static void pattern_fill (pset_t **grid, rng_t *rng)
 {
-  srand(time(NULL));
+  int lines[grid_size];
+  int rows[grid_size];
+  int colors[grid_size];
+  int bands[block_size];
+  int inside[block_size];
+  bool transpose = rng_below(rng, 2);
+
+  for (int i = 0; i<grid_size; i++) {
+    colors[i] = i;
+  }
+  shuffle(colors, grid_size, rng);
+
+  /* lines then rows : the same transformation on both axes */
+  for (int axis = 0; axis<2; axis++) {
+    int *map = (axis == 0) ? lines : rows;
+
+    for (int i = 0; i<block_size; i++) {
+      bands[i] = i;
+    }
+    shuffle(bands, block_size, rng);
+    for (int band = 0; band<block_size; band++) {
+      for (int i = 0; i<block_size; i++) {
+        inside[i] = i;
+      }
+      shuffle(inside, block_size, rng);
+      for (int i = 0; i<block_size; i++) {
+        map[band * block_size + i] = bands[band] * block_size + inside[i];
+      }
+    }
+  }
 
-  grid = grid_alloc();
-  /*fill the grid with full*/
   for (int j = 0; j<grid_size; j++) {
     for (int i = 0; i<grid_size; i++) {
-      grid[j][i] = pset_full(grid_size);
+      int line = transpose ? rows[i] : lines[j];
+      int row = transpose ? lines[j] : rows[i];
+      int color = (block_size * (line % block_size) + line / block_size + row)
+                  % grid_size;
+      grid[j][i] = pset_from_index(colors[color]);
+    }
+  }
+}
+
+
+/* remove the clues one at a time in a random order, keeping a removal only
+   if the grid still has only one solution. No clue can be removed from the
+   resulting grid.
+   With a rating, a removal is also only kept if the grade stays at most
+   grade_high, and the removals stop as soon as it reaches grade_low : the
+   rating gives up once the grade is too high, and its search for two
+   solutions is the uniqueness check. Return false if the grade stayed below
+   grade_low. */
+static bool remove_to_minimal (engine_t *engine, rating_t *rating,
+                               pset_t **grid, const pset_t *solution,
+                               rng_t *rng)
+{
+  int ncells = grid_size * grid_size;
+  int *order = malloc(ncells * sizeof(int));
+  pset_t *cells = malloc(ncells * sizeof(pset_t));
+  double reached = 0.0;
+  if (order == NULL || cells == NULL) {
+    out_of_memory();
+  }
+  for (int cell = 0; cell<ncells; cell++) {
+    order[cell] = cell;
+  }
+  shuffle(order, ncells, rng);
+
+  for (int k = 0; k<ncells; k++) {
+    int cell = order[k];
+    pset_t *place = &grid[cell / grid_size][cell % grid_size];
+
+    if (!pset_equal(*place, pset_full(grid_size))) {
+      pset_t clue = *place;
+      *place = pset_full(grid_size);
+      grade_t grade;
+      bool unique;
+      if (rating != NULL) {
+        /* the deductions of the last rating held the removed clue */
+        grid_flatten(grid, cells);
+        unique = rating_rate(rating, cells, grade_high, &grade) &&
+                 grade.solutions == 1;
+        if (budget_exceeded(engine->budget)) {
+          budget_exceeded_in_generation();
+        }
+      } else {
+        unique = only_one_solution(engine, grid, solution, &cell, 1);
+      }
+      if (!unique) {
+        *place = clue;
+      }
+      if (TRACE_ON(trace)) {
+        trace_event(trace, unique ? TRACE_CLUE_REMOVED : TRACE_CLUE_KEPT,
+                    TRACE_GIVEN, 0, cell, pset_index(clue), 1);
+      }
+      if (unique && rating != NULL) {
+        reached = grade.grade;
+        if (reached >= grade_low) {
+          break;
+        }
+      }
+    }
+  }
+  free(cells);
+  free(order);
+  return rating == NULL || reached >= grade_low;
+}
+
+
+/* generate a grid with the random stream rng. The engine and the rating
+   (NULL without -G) are only there for their memory to be reused from one
+   grid to the next : each removal is rated again from the grid. The budget
+   of the engine bounds the generation. Return NULL if the grid couldn't be
+   brought in the grade band. */
+static pset_t **generate_grid (rng_t *rng, engine_t *engine,
+                               rating_t *rating)
+{
+  pset_t **grid = grid_alloc();
+
+  if (trace != NULL) {
+    /* the decoder needs the size, whatever the sampling */
+    trace->sampled = true;
+    trace_event(trace, TRACE_GRID, TRACE_NO_RULE, 0, -1, -1, grid_size);
+  }
+
+  if (construction == CONSTRUCT_PATTERN) {
+    pattern_fill(grid, rng);
+  } else {
+    /*fill the grid with full*/
+    for (int j = 0; j<grid_size; j++) {
+      for (int i = 0; i<grid_size; i++) {
+        grid[j][i] = pset_full(grid_size);
+      }
+    }
+    
+    /* we place randomly a number to guide to a random grid */
+    place_a_singleton(grid, rng);
+    
+    if (grid_solver(grid, engine->budget) == UNKNOWN) {
+      budget_exceeded_in_generation();
     }
   }
   
-  /* we place randomly a number to guide to a random grid */
-  place_a_singleton(grid);
-  
-  grid_solver(grid);
-  
+  /* the known solution is what makes the uniqueness check fast */
+  pset_t *solution = malloc(grid_size * grid_size * sizeof(pset_t));
+  int *removed = malloc(grid_size * sizeof(int));
+  if (solution == NULL || removed == NULL) {
+    out_of_memory();
+  }
+  grid_flatten(grid, solution);
+
+  if (minimal || rating != NULL) {
+    bool graded = remove_to_minimal(engine, rating, grid, solution, rng);
+    free(removed);
+    free(solution);
+    if (!graded) {
+      grid_free(grid);
+      return NULL;
+    }
+    return grid;
+  }
 
   int cells_to_remove = ((grid_size*grid_size) / RATIO_GRID_SIZE);
   /*we remove two third of all the cells*/
@@ -705,24 +1472,239 @@ static void generate_grid (void)
     pset_t **temporary_grid = grid_copy(grid);
 
     for (int i = 0; i<grid_size; i++) {
-      remove_random_cell(grid);
+      removed[i] = remove_random_cell(grid, rng);
     }
 
-    if (strict && !only_one_solution(grid)) {
+    bool unique = !strict ||
+                  only_one_solution(engine, grid, solution, removed, grid_size);
+    if (!unique) {
       grid_rewrite(grid, temporary_grid);
     } else {
       cells_to_remove -= grid_size;/*we remove grid_size cells each time*/
-      if (verbose) {
-        grid_print(grid);
-      }    
+    }
+    for (int i = 0; TRACE_ON(trace) && i<grid_size; i++) {
+      trace_event(trace, unique ? TRACE_CLUE_REMOVED : TRACE_CLUE_KEPT,
+                  TRACE_GIVEN, 0, removed[i], pset_index(solution[removed[i]]),
+                  1);
     }
 
     grid_free(temporary_grid);
   }
+
+  free(removed);
+  free(solution);
+  return grid;
 }
- 
 
-static void close_and_check(FILE *pFILE)
+
+/* Hash of a grid where the colors are renamed in their order of first
+   appearance, so that two grids which only differ by a relabelling of their
+   colors have the same hash (FNV-1a). It is only invariant by relabelling :
+   grids which differ by a permutation of lines, rows, bands or stacks, or a
+   transposition, are different grids for it. */
+static uint64_t relabel_hash (pset_t **grid)
+{
+  int names[grid_size];
+  int next_name = 1;
+  uint64_t hash = 0xCBF29CE484222325;
+
+  for (int i = 0; i<grid_size; i++) {
+    names[i] = 0;
+  }
+  for (int j = 0; j<grid_size; j++) {
+    for (int i = 0; i<grid_size; i++) {
+      int name = 0;
+      if (pset_is_singleton(grid[j][i])) {
+        int color = pset_index(grid[j][i]);
+        if (names[color] == 0) {
+          names[color] = next_name;
+          next_name++;
+        }
+        name = names[color];
+      }
+      hash = (hash ^ name) * 0x100000001B3;
+    }
+  }
+  /* 0 marks the free slots of the hash table */
+  return (hash == 0) ? 1 : hash;
+}
+
+
+/* state shared by the threads generating a batch of grids */
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t turn;   /* signaled when a slot is filled, or at the end */
+  int jobs;
+  int wanted;
+  int produced;          /* also the slot being filled */
+  int duplicates;        /* generated in a row */
+  uint64_t *hashes;      /* open addressing table of the produced grids */
+  int hashes_size;       /* a power of 2, more than twice wanted */
+} batch_t;
+
+typedef struct {
+  pthread_t thread;
+  batch_t *batch;
+  int slot;                /* the next slot it fills */
+  rng_t rng;
+  budget_t budget;
+  metrics_shard_t *shard;  /* NULL without metrics */
+} generator_t;
+
+
+/* add hash to the table, return false if it was already there */
+static bool batch_insert (batch_t *batch, uint64_t hash)
+{
+  int slot = hash & (batch->hashes_size - 1);
+
+  while (batch->hashes[slot] != 0) {
+    if (batch->hashes[slot] == hash) {
+      return false;
+    }
+    slot = (slot + 1) & (batch->hashes_size - 1);
+  }
+  batch->hashes[slot] = hash;
+  return true;
+}
+
+
+static void *generator_main (void *data)
+{
+  generator_t *generator = data;
+  batch_t *batch = generator->batch;
+  engine_t *engine = engine_new(grid_size);
+  if (scalar) {
+    engine_set_bitboards(engine, false);
+  }
+  engine->budget = &generator->budget;
+  engine->trace = trace;
+  rating_t *rating = grading ? rating_new(grid_size, &generator->budget)
+                              : NULL;
+
+  while (generator->slot < batch->wanted) {
+    uint64_t start = metrics_now();
+    uint64_t nodes = generator->budget.nodes;
+    pset_t **puzzle = generate_grid(&generator->rng, engine, rating);
+    uint64_t hash = (puzzle != NULL) ? relabel_hash(puzzle) : 0;
+    uint64_t latency = metrics_now() - start;
+    bool kept = false;
+    bool done;
+
+    /* the grid is only compared to the ones of the slots before its own,
+       so the same grids are kept whatever the threads timing */
+    pthread_mutex_lock(&batch->lock);
+    while (batch->produced < generator->slot &&
+           batch->duplicates < MAX_DUPLICATES) {
+      pthread_cond_wait(&batch->turn, &batch->lock);
+    }
+    if (batch->duplicates >= MAX_DUPLICATES) {
+      done = true;
+    } else if (puzzle != NULL && batch_insert(batch, hash)) {
+      /* the grids are printed with the lock held, in the slots order */
+      grid_print(puzzle);
+      batch->produced++;
+      batch->duplicates = 0;
+      generator->slot += batch->jobs;
+      kept = true;
+      done = false;
+    } else {
+      /* found twice or out of the grade band : the slot is drawn again */
+      batch->duplicates++;
+      done = (batch->duplicates >= MAX_DUPLICATES);
+    }
+    if (kept || done) {
+      pthread_cond_broadcast(&batch->turn);
+    }
+    pthread_mutex_unlock(&batch->lock);
+
+    if (kept && generator->shard != NULL) {
+      /* the uniqueness of a grid is only known with -s */
+      metrics_record(generator->shard, grid_size,
+                     strict ? METRICS_UNIQUE : METRICS_UNKNOWN,
+                     latency, generator->budget.nodes - nodes);
+    }
+
+    if (puzzle != NULL) {
+      grid_free(puzzle);
+    }
+    if (done) {
+      break;
+    }
+  }
+
+  if (rating != NULL) {
+    rating_free(rating);
+  }
+  engine_free(engine);
+  return NULL;
+}
+
+
+/* Generate wanted different grids with jobs threads, and print them in
+   order. Thread k fills the slots k, k + jobs, k + 2 * jobs... drawing
+   from the stream k of the seed, and draws a slot again when its grid is
+   found in an earlier slot : a run is reproducible, grids and order, with
+   the same seed and the same number of jobs. */
+static void generate_batch (int wanted)
+{
+  batch_t batch;
+  generator_t *generators = calloc(jobs, sizeof(generator_t));
+  if (generators == NULL) {
+    out_of_memory();
+  }
+
+  if (construction == CONSTRUCT_DEFAULT) {
+    construction = (grid_size > MAX_SEARCH_CONSTRUCTION) ? CONSTRUCT_PATTERN
+                                                         : CONSTRUCT_SEARCH;
+  }
+
+  pthread_mutex_init(&batch.lock, NULL);
+  pthread_cond_init(&batch.turn, NULL);
+  batch.jobs = jobs;
+  batch.wanted = wanted;
+  batch.produced = 0;
+  batch.duplicates = 0;
+  batch.hashes_size = 4;
+  while (batch.hashes_size < 2 * wanted) {
+    batch.hashes_size *= 2;
+  }
+  batch.hashes = calloc(batch.hashes_size, sizeof(uint64_t));
+  if (batch.hashes == NULL) {
+    out_of_memory();
+  }
+
+  for (int i = 0; i<jobs; i++) {
+    generators[i].batch = &batch;
+    generators[i].slot = i;
+    rng_seed(&generators[i].rng, seed, i);
+    budget_fork(&generators[i].budget, &budget);
+    generators[i].shard = (metrics != NULL) ? metrics_shard(metrics, i) : NULL;
+  }
+  for (int i = 0; i<jobs; i++) {
+    if (pthread_create(&generators[i].thread, NULL, generator_main,
+                       &generators[i]) != 0) {
+      fprintf(stderr,"sudoku: error: can't create a thread.\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  for (int i = 0; i<jobs; i++) {
+    pthread_join(generators[i].thread, NULL);
+    budget_join(&generators[i].budget);
+  }
+
+  if (batch.produced < wanted) {
+    fprintf(stderr,"sudoku: warning: only %d different grids have been "
+                   "found.\n", batch.produced);
+  }
+
+  free(batch.hashes);
+  pthread_cond_destroy(&batch.turn);
+  pthread_mutex_destroy(&batch.lock);
+  free(generators);
+}
+ 
+
+static void close_and_check(FILE *pFILE)
 {
   if (fclose(pFILE)!=0) {
     fprintf(stderr, "File closing error.\n");
@@ -732,38 +1714,804 @@ static void close_and_check(FILE *pFILE)
 
 
 
+static bool print_solution (engine_t *engine, void *data)
+{
+  (void) data;
+  cells_print(engine->cells);
+  return true;
+}
+
+
+/* SIGALRM and SIGUSR1 save the search, SIGINT and SIGTERM save it and stop
+   it (or only stop it when nothing is being searched) */
+static void checkpoint_handler (int signum)
+{
+  if (signum == SIGINT || signum == SIGTERM) {
+    stop_requested = 1;
+    if (searching == NULL) {
+      budget_cancel(&budget);
+    }
+  }
+  if (searching != NULL) {
+    searching->checkpoint = 1;
+  }
+}
+
+
+static void checkpoint_signals (void)
+{
+  struct sigaction action;
+  int signals[] = {SIGALRM, SIGUSR1, SIGINT, SIGTERM};
+
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = checkpoint_handler;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  for (unsigned k = 0; k<sizeof(signals) / sizeof(int); k++) {
+    sigaction(signals[k], &action, NULL);
+  }
+}
+
+
+/* The checkpoint is the options of the search, then the engine, then the
+   first solution found when solving. It is written next to checkpoint_path
+   then renamed, so that a kill while writing leaves the previous one. */
+static bool save_checkpoint (engine_t *engine, void *data)
+{
+  uint64_t limit = *(uint64_t *) data;
+  char temporary[strlen(checkpoint_path) + 5];
+  FILE *file;
+  bool saved = false;
+
+  sprintf(temporary, "%s.tmp", checkpoint_path);
+  file = fopen(temporary, "w");
+  if (file != NULL) {
+    fprintf(file, "sudoku checkpoint\nmode %s\nlimit %llu\nnodes %llu\n",
+            enumerate ? "enumerate" : (count ? "count" : "solve"),
+            (unsigned long long) limit, (unsigned long long) budget.nodes);
+    saved = engine_save(engine, file);
+
+    bool first = !count && !enumerate && engine->solutions >= 1;
+    fprintf(file, "solution %d", first ? 1 : 0);
+    for (int c = 0; first && c<grid_size * grid_size; c++) {
+      fprintf(file, " %d", pset_index(grid[c / grid_size][c % grid_size]) + 1);
+    }
+    fprintf(file, "\n");
+    saved = (fclose(file) == 0) && saved &&
+            rename(temporary, checkpoint_path) == 0;
+  }
+
+  if (!saved) {
+    fprintf(stderr, "sudoku: error: can't write the checkpoint '%s'.\n",
+            checkpoint_path);
+  } else if (verbose) {
+    fprintf(stderr, "sudoku: search saved to '%s' after %llu nodes.\n",
+            checkpoint_path, (unsigned long long) budget.nodes);
+  }
+  alarm(checkpoint_interval_s);
+  return !stop_requested;
+}
+
+
+/* read the checkpoint of resume_path : the options of the search are taken
+   from it, the grid is its starting grid (or its first solution) */
+static void load_checkpoint (void)
+{
+  char mode[16];
+  unsigned long long limit, nodes;
+  int first;
+
+  if (fscanf(pFILEinput, " sudoku checkpoint mode %15s limit %llu "
+             "nodes %llu", mode, &limit, &nodes) != 3 ||
+      (resumed = engine_resume(pFILEinput)) == NULL ||
+      fscanf(pFILEinput, " solution %d", &first) != 1) {
+    fprintf(stderr,"sudoku: error: '%s' isn't a checkpoint.\n", resume_path);
+    exit(EXIT_FAILURE);
+  }
+  count = (strcmp(mode, "count") == 0);
+  enumerate = (strcmp(mode, "enumerate") == 0);
+  count_limit = limit;
+  resumed_nodes = nodes;
+
+  grid_size = resumed->size;
+  block_size = sqrt(grid_size);
+  grid = grid_alloc();
+  pset_t *root = malloc(resumed->ncells * sizeof(pset_t));
+  if (root == NULL) {
+    out_of_memory();
+  }
+  engine_root(resumed, root);
+  for (int c = 0; c<resumed->ncells; c++) {
+    int color;
+    if (first == 1 && fscanf(pFILEinput, "%d", &color) == 1 &&
+        color >= 1 && color <= grid_size) {
+      root[c] = pset_from_index(color - 1);
+    }
+    grid[c / grid_size][c % grid_size] = root[c];
+  }
+  free(root);
+}
+
+
+/* the engine of the search : the resumed one, or a new one on cells */
+static engine_t *search_engine (const pset_t *cells)
+{
+  engine_t *engine = resumed;
+
+  if (engine == NULL) {
+    engine = engine_new(grid_size);
+    if (scalar) {
+      engine_set_bitboards(engine, false);
+    }
+    engine_load(engine, cells);
+  }
+  resumed = NULL;
+  return engine;
+}
+
+
+/* engine_search, saving the search from time to time if asked */
+static int run_search (engine_t *engine, uint64_t limit,
+                       engine_solution_fn on_solution, void *data)
+{
+  if (checkpoint_path == NULL) {
+    return engine_search(engine, limit, on_solution, data);
+  }
+
+  engine->on_checkpoint = save_checkpoint;
+  engine->checkpoint_data = &limit;
+  searching = engine;
+  if (stop_requested) {
+    engine->checkpoint = 1;
+  }
+  alarm(checkpoint_interval_s);
+
+  int result = engine_search(engine, limit, on_solution, data);
+
+  searching = NULL;
+  /* stopped by the budget : saved there, it goes on as if never stopped */
+  if (result == ENGINE_STOPPED && !stop_requested) {
+    save_checkpoint(engine, &limit);
+  }
+  alarm(0);
+  if (result == ENGINE_STOPPED) {
+    fprintf(stderr, "sudoku: search saved to '%s', go on with --resume=%s\n",
+            checkpoint_path, checkpoint_path);
+  }
+  return result;
+}
+
+
+/* count (and enumerate if asked) the solutions of the loaded grid, and
+   return its result class */
+static int count_solutions (void)
+{
+  pset_t *cells = malloc(grid_size * grid_size * sizeof(pset_t));
+  if (cells == NULL) {
+    out_of_memory();
+  }
+  grid_flatten(grid, cells);
+
+  uint64_t solutions;
+  int result;
+  engine_solution_fn on_solution = enumerate ? print_solution : NULL;
+
+  if (jobs == 1) {
+    engine_t *engine = search_engine(cells);
+    engine->budget = &budget;
+    engine->trace = trace;
+    result = run_search(engine, count_limit, on_solution, NULL);
+    solutions = engine->solutions;
+    engine_free(engine);
+  } else {
+    bool bitboards = !scalar && grid_size <= ENGINE_BITBOARD_SIZE;
+    result = engine_search_parallel(grid_size, cells, jobs, bitboards,
+                                    count_limit, on_solution, NULL, &budget,
+                                    &solutions);
+  }
+
+  const char *plural = (solutions == 1) ? "" : "s";
+  if (result == ENGINE_DONE) {
+    printf("There %s exactly %llu solution%s\n",
+           (solutions == 1) ? "is" : "are", (unsigned long long) solutions,
+           plural);
+  } else if (result == ENGINE_LIMIT) {
+    printf("There are at least %llu solution%s (limit reached)\n",
+           (unsigned long long) solutions, plural);
+  } else {
+    printf("The search has been stopped after %llu nodes. "
+           "There are at least %llu solution%s\n",
+           (unsigned long long) budget.nodes, (unsigned long long) solutions,
+           plural);
+  }
+  free(cells);
+
+  if (solutions > 1) {
+    return METRICS_MULTIPLE;
+  } else if (result == ENGINE_STOPPED) {
+    return METRICS_UNKNOWN;
+  } else if (solutions == 1) {
+    return (result == ENGINE_DONE) ? METRICS_UNIQUE : METRICS_UNKNOWN;
+  }
+  return METRICS_INCONSISTENT;
+}
+
+
+/* Ctrl-C stops the search cleanly : the partial grid is still printed */
+static void interrupt_handler (int signum)
+{
+  (void) signum;
+  budget_cancel(&budget);
+}
+
+
+static bool keep_first_solution (engine_t *engine, void *data)
+{
+  pset_t **grid = data;
+
+  if (engine->solutions == 1) {
+    for (int j = 0; j<grid_size; j++) {
+      for (int i = 0; i<grid_size; i++) {
+        grid[j][i] = engine->cells[j * grid_size + i];
+      }
+    }
+  }
+  return true;
+}
+
+
+/* Same results as grid_solver, but with the engine which undoes its changes
+   instead of copying the grid at each node : grid_solver is too slow for the
+   grids with more colors than characters, and its recursion can't be
+   saved. */
+static int engine_solver (pset_t **grid, budget_t *budget)
+{
+  pset_t *cells = malloc(grid_size * grid_size * sizeof(pset_t));
+  int result;
+
+  if (cells == NULL) {
+    out_of_memory();
+  }
+  grid_flatten(grid, cells);
+  engine_t *engine = search_engine(cells);
+  free(cells);
+  engine->budget = budget;
+  engine->trace = trace;
+  if (run_search(engine, 2, keep_first_solution, grid) == ENGINE_STOPPED) {
+    result = UNKNOWN;
+  } else {
+    result = engine->solutions;
+  }
+  engine_free(engine);
+  return result;
+}
+
+
+/* solve (or count the solutions of) the grid and print the result.
+   spent_ns is the time already spent on the grid, for the metrics. */
+static void solve_grid (uint64_t spent_ns)
+{
+  uint64_t start = metrics_now();
+  int result;
+
+  budget_restart(&budget, timeout_ms, max_nodes);
+  budget.nodes = resumed_nodes;
+  if (trace != NULL) {
+    trace->sampled = true;
+    trace_event(trace, TRACE_GRID, TRACE_NO_RULE, 0, -1, -1, grid_size);
+  }
+
+  if (count || enumerate) {
+    result = count_solutions();
+    if (metrics != NULL) {
+      metrics_record(metrics_shard(metrics, 0), grid_size, result,
+                     spent_ns + metrics_now() - start, budget.nodes);
+    }
+    return;
+  }
+
+  int temp = (grid_size > CHAR_COLORS || checkpoint_path != NULL)
+               ? engine_solver(grid, &budget) : grid_solver(grid, &budget);
+
+  if (temp==UNKNOWN) {
+    result = METRICS_UNKNOWN;
+  } else if (temp>=2) {
+    result = METRICS_MULTIPLE;
+  } else if (temp==1) {
+    result = METRICS_UNIQUE;
+  } else {
+    result = METRICS_INCONSISTENT;
+  }
+  if (metrics != NULL) {
+    metrics_record(metrics_shard(metrics, 0), grid_size, result,
+                   spent_ns + metrics_now() - start, budget.nodes);
+  }
+
+  if (temp==UNKNOWN) {
+    printf("The search has been stopped after %llu nodes. "
+           "It's unknown whether the grid has a solution\n",
+           (unsigned long long) budget.nodes);
+  } else if (temp>=2) {
+    printf("The grid has been solved. There is >%d solutions\n", temp);
+  } else if (temp==1) {
+    printf("The grid has been solved. There is only one solution\n");
+  } else {
+    printf("The grid isn't consistant.\n");
+  }
+  
+  grid_print(grid);
+}
+
+
+/* Solve the n grids of pending, then free them. Grids of size 9 and 16 are
+   first propagated together in SIMD lanes : the ones solved there are
+   printed right away, the others are solved again from scratch by
+   grid_solver, so that the output is the same as without the lanes.
+   Return how many grids the lanes have solved. */
+static int solve_pending (pset_t ***pending, int n)
+{
+  int ncells = grid_size * grid_size;
+  int solved = 0;
+  int status[n];
+  uint16_t *cells = NULL;
+  uint64_t lanes_ns = 0;
+
+  for (int k = 0; k<n; k++) {
+    status[k] = LANES_OPEN;
+  }
+
+  if (!scalar && !count && !enumerate &&
+      (grid_size == 9 || grid_size == 16)) {
+    cells = malloc(n * ncells * sizeof(uint16_t));
+    if (cells == NULL) {
+      out_of_memory();
+    }
+    for (int k = 0; k<n; k++) {
+      for (int j = 0; j<grid_size; j++) {
+        for (int i = 0; i<grid_size; i++) {
+          uint64_t colors = pset_first_word(pending[k][j][i]);
+          cells[k * ncells + j * grid_size + i] = (uint16_t) colors;
+        }
+      }
+    }
+    uint64_t start = metrics_now();
+    lanes_propagate(grid_size, n, cells, status);
+    /* each grid gets its share of the time of the lanes */
+    lanes_ns = (metrics_now() - start) / n;
+  }
+
+  for (int k = 0; k<n; k++) {
+    grid = pending[k];
+    if (budget_cancelled(&budget)) {
+      /* interrupted : the rest of the batch is dropped */
+      grid_free(grid);
+      continue;
+    }
+    if (status[k] == LANES_SOLVED) {
+      for (int j = 0; j<grid_size; j++) {
+        for (int i = 0; i<grid_size; i++) {
+          uint16_t colors = cells[k * ncells + j * grid_size + i];
+          grid[j][i] = pset_from_first_word(colors);
+        }
+      }
+      /* propagation alone only makes forced choices */
+      printf("The grid has been solved. There is only one solution\n");
+      grid_print(grid);
+      solved++;
+      if (metrics != NULL) {
+        metrics_record(metrics_shard(metrics, 0), grid_size, METRICS_UNIQUE,
+                       lanes_ns, 0);
+      }
+    } else {
+      solve_grid(lanes_ns);
+    }
+    grid_free(grid);
+  }
+
+  free(cells);
+  return solved;
+}
+
+
+/* solve every grid of the input file, lanes_width() grids at a time */
+static void solve_batch (void)
+{
+  int width = lanes_width();
+  pset_t **pending[width];
+  int n = 0;
+  int first_size = 0;
+  int grids = 0;
+  int solved_in_lanes = 0;
+  struct timespec start, end;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (;;) {
+    bool more = grid_read(pFILEinput, true);
+
+    if (more) {
+      if (grids == 0) {
+        first_size = grid_size;
+      } else if (grid_size != first_size) {
+        fprintf(stderr,"sudoku: error: grid %d is %dx%d, the first one "
+                       "was %dx%d.\n", grids, grid_size, grid_size,
+                       first_size, first_size);
+        usage(EXIT_FAILURE);
+      }
+      pending[n] = grid;
+      n++;
+      grids++;
+    } else {
+      /* grid_parser has found no grid, but the pending ones are this big */
+      grid_size = first_size;
+      block_size = sqrt(grid_size);
+    }
+
+    if (n == width || (!more && n > 0)) {
+      solved_in_lanes += solve_pending(pending, n);
+      n = 0;
+    }
+    if (!more || budget_cancelled(&budget)) {
+      break;
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  if (budget_cancelled(&budget)) {
+    fprintf(stderr, "sudoku: warning: the batch has been interrupted.\n");
+  }
+  double seconds = (end.tv_sec - start.tv_sec) +
+                   (end.tv_nsec - start.tv_nsec) / 1e9;
+  fprintf(stderr, "sudoku: %d grids in %.3f s (%.0f grids/s), %d solved "
+                  "in %d %s lanes.\n", grids, seconds,
+                  (seconds > 0) ? grids / seconds : 0.0, solved_in_lanes,
+                  scalar ? 0 : width, scalar ? "scalar" : lanes_target());
+}
+
+
+static void color_print (pset_t color)
+{
+  if (tokens || grid_size > CHAR_COLORS) {
+    token_print(color);
+  } else {
+    char colors[MAX_COLORS + 1];
+    pset2str(colors, color);
+    fprintf(pFILEoutput, "%s", colors);
+  }
+}
+
+
+static void violation_print (int n, const verify_error_t *error)
+{
+  static const char *units[] = {"line", "row", "block"};
+  int line = error->cell / grid_size;
+  int row = error->cell % grid_size;
+
+  fprintf(pFILEoutput, "grid %d: ", n);
+  if (error->kind == VERIFY_CELL) {
+    fprintf(pFILEoutput, "the cell at line %d, row %d has %s.\n", line, row,
+            pset_is_empty(error->color) ? "no color" : "several colors");
+  } else if (error->kind == VERIFY_GIVEN) {
+    fprintf(pFILEoutput, "the cell at line %d, row %d isn't the given ",
+            line, row);
+    color_print(error->color);
+    fprintf(pFILEoutput, ".\n");
+  } else {
+    fprintf(pFILEoutput, "%s %d has ", units[error->kind - VERIFY_LINE],
+            error->unit);
+    color_print(error->color);
+    fprintf(pFILEoutput, " twice (again at line %d, row %d).\n", line, row);
+  }
+}
+
+
+/* Check every solved grid of the input file. The grids go by pairs, a
+   puzzle and its solution, which must keep its givens : a solution is
+   never taken for the next puzzle, even with blanks. With solved_only,
+   every grid is a solution checked on its own. Only the wrong solutions
+   are reported, by their number in the file (from 0).
+   Return the number of wrong solutions. */
+static int verify_batch (void)
+{
+  pset_t *givens = NULL;
+  pset_t *cells = NULL;
+  int allocated = 0;
+  int grids = 0;
+  int checked = 0;
+  int wrong = 0;
+  struct timespec start, end;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  while (grid_read(pFILEinput, true)) {
+    int size = grid_size;
+
+    if (size * size > allocated) {
+      allocated = size * size;
+      givens = realloc(givens, allocated * sizeof(pset_t));
+      cells = realloc(cells, allocated * sizeof(pset_t));
+      if (givens == NULL || cells == NULL) {
+        out_of_memory();
+      }
+    }
+    grid_flatten(grid, solved_only ? cells : givens);
+    grid_free(grid);
+    grids++;
+    checked++;
+
+    if (!solved_only) {
+      if (!grid_read(pFILEinput, true)) {
+        fprintf(pFILEoutput, "grid %d: a puzzle without its solution.\n",
+                grids - 1);
+        wrong++;
+        break;
+      }
+      grids++;
+      if (grid_size != size) {
+        fprintf(pFILEoutput, "grid %d: the solution is %dx%d, its puzzle "
+                "is %dx%d.\n", grids - 1, grid_size, grid_size, size, size);
+        grid_free(grid);
+        wrong++;
+        continue;
+      }
+      grid_flatten(grid, cells);
+      grid_free(grid);
+    }
+
+    verify_error_t error;
+    if (!verify_grid(size, cells, solved_only ? NULL : givens, &error)) {
+      violation_print(grids - 1, &error);
+      wrong++;
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  free(givens);
+  free(cells);
+
+  double seconds = (end.tv_sec - start.tv_sec) +
+                   (end.tv_nsec - start.tv_nsec) / 1e9;
+  fprintf(stderr, "sudoku: %d solutions checked in %.3f s (%.0f grids/s), "
+                  "%d valid, %d wrong.\n", checked, seconds,
+                  (seconds > 0) ? checked / seconds : 0.0, checked - wrong,
+                  wrong);
+  return wrong;
+}
+
+
+/* rate every grid of the input file, numbered from 0 */
+static void rate_batch (void)
+{
+  rating_t *rating = NULL;
+  pset_t *cells = NULL;
+  int grids = 0;
+
+  while (grid_read(pFILEinput, true)) {
+    if (rating == NULL || rating->engine->size != grid_size) {
+      if (rating != NULL) {
+        rating_free(rating);
+      }
+      rating = rating_new(grid_size, &budget);
+      free(cells);
+      cells = malloc(grid_size * grid_size * sizeof(pset_t));
+      if (cells == NULL) {
+        out_of_memory();
+      }
+    }
+    grid_flatten(grid, cells);
+    grid_free(grid);
+
+    grade_t grade;
+    budget_restart(&budget, timeout_ms, max_nodes);
+    if (!rating_rate(rating, cells, RATING_NO_CEILING, &grade)) {
+      fprintf(pFILEoutput, "grid %d: the rating has been stopped after %llu "
+              "nodes.\n", grids, (unsigned long long) grade.nodes);
+      grids++;
+      if (budget_cancelled(&budget)) {
+        break;
+      }
+      continue;
+    }
+    fprintf(pFILEoutput, "grid %d: grade %.2f (%s), %s, %llu nodes\n",
+            grids, grade.grade, rating_technique_name(grade.hardest),
+            (grade.solutions == 0) ? "not consistent" :
+            (grade.solutions == 1) ? "one solution" : "several solutions",
+            (unsigned long long) grade.nodes);
+    if (verbose) {
+      for (int t = 0; t<RATING_TECHNIQUES; t++) {
+        fprintf(pFILEoutput, "%s %s %llu", (t == 0) ? "  " : ",",
+                rating_technique_name(t), (unsigned long long) grade.uses[t]);
+      }
+      fprintf(pFILEoutput, "\n");
+    }
+    grids++;
+  }
+
+  if (rating != NULL) {
+    rating_free(rating);
+  }
+  free(cells);
+}
+
+
+/* read a cell as "LINE ROW" (from 0), return -1 if it isn't one */
+static int session_cell (const char *arg)
+{
+  int line, row;
+
+  if (arg == NULL || sscanf(arg, "%d %d", &line, &row) != 2 ||
+      line < 0 || line >= grid_size || row < 0 || row >= grid_size) {
+    return -1;
+  }
+  return line * grid_size + row;
+}
+
+
+/* Edit the grid of the input file with the commands read on the standard
+   input, one by line, each one answered on a line :
+     place LINE ROW COLOR    ok, or inconsistent
+     remove LINE ROW         ok, or no given
+     undo                    ok, or nothing to undo (the last place or
+                             remove not undone yet)
+     solvable, unique        yes or no
+     hint                    LINE ROW COLOR forced|guess, or none
+     print                   the propagated grid
+     quit
+   Lines and rows are numbered from 0, colors from 1. The searches of each
+   command are bounded by -t and -n : they answer unknown when stopped. */
+static void session_loop (void)
+{
+  char line[256];
+
+  grid_read(pFILEinput, false);
+  pset_t *cells = malloc(grid_size * grid_size * sizeof(pset_t));
+  if (cells == NULL) {
+    out_of_memory();
+  }
+  grid_flatten(grid, cells);
+  grid_free(grid);
+  session_t *session = session_new(grid_size, &budget);
+  session_load(session, cells);
+  free(cells);
+
+  while (fgets(line, sizeof(line), stdin) != NULL) {
+    char name[16];
+    int offset = 0;
+    if (sscanf(line, "%15s %n", name, &offset) != 1) {
+      continue;
+    }
+    const char *args = line + offset;
+    uint64_t start = metrics_now();
+    budget_restart(&budget, timeout_ms, max_nodes);
+
+    if (strcmp(name, "quit") == 0) {
+      break;
+    } else if (strcmp(name, "place") == 0) {
+      int cell = session_cell(args);
+      int color = 0;
+      sscanf(args, "%*d %*d %d", &color);
+      if (cell < 0 || color < 1 || color > grid_size) {
+        fprintf(pFILEoutput, "error: place LINE ROW COLOR\n");
+      } else {
+        fprintf(pFILEoutput, "%s\n", session_place(session, cell, color - 1) ?
+                "ok" : "inconsistent");
+      }
+    } else if (strcmp(name, "remove") == 0) {
+      int cell = session_cell(args);
+      if (cell < 0) {
+        fprintf(pFILEoutput, "error: remove LINE ROW\n");
+      } else {
+        fprintf(pFILEoutput, "%s\n", session_remove(session, cell) ?
+                "ok" : "no given");
+      }
+    } else if (strcmp(name, "undo") == 0) {
+      fprintf(pFILEoutput, "%s\n", session_undo(session) ? "ok"
+                                                       : "nothing to undo");
+    } else if (strcmp(name, "solvable") == 0) {
+      int solutions = session_solutions(session);
+      fprintf(pFILEoutput, "%s\n", (solutions < 0) ? "unknown" :
+              (solutions > 0) ? "yes" : "no");
+    } else if (strcmp(name, "unique") == 0) {
+      int solutions = session_solutions(session);
+      fprintf(pFILEoutput, "%s\n", (solutions < 0) ? "unknown" :
+              (solutions == 1) ? "yes" : "no");
+    } else if (strcmp(name, "hint") == 0) {
+      int color;
+      bool forced;
+      int cell = session_hint(session, &color, &forced);
+      if (cell < 0) {
+        fprintf(pFILEoutput, "%s\n", (session->solutions < 0) ? "unknown"
+                                                              : "none");
+      } else {
+        fprintf(pFILEoutput, "%d %d %d %s\n", cell / grid_size,
+                cell % grid_size, color + 1, forced ? "forced" : "guess");
+      }
+    } else if (strcmp(name, "print") == 0) {
+      cells_print(session_cells(session));
+    } else {
+      fprintf(pFILEoutput, "error: unknown command '%s'\n", name);
+    }
+    fflush(pFILEoutput);
+
+    if (verbose) {
+      fprintf(stderr, "sudoku: %s in %.1f us\n", name,
+              (metrics_now() - start) / 1e3);
+    }
+    if (budget_cancelled(&budget)) {
+      break;
+    }
+  }
+  session_free(session);
+}
+
 int main (int argc, char *argv[])
 { 
+  int status = EXIT_SUCCESS;
   progName = argv[0];
 
   check_options (argc,argv);
-  
-  if (!generate) {
-    grid_parser(pFILEinput);
 
-    int temp = grid_solver(grid);
+  if (metrics_path != NULL) {
+    metrics = metrics_new(jobs, metrics_path, metrics_interval_ms);
+  }
+  if (trace_path != NULL) {
+    trace = trace_new(trace_path, trace_sample);
+    if (trace == NULL) {
+      fprintf(stderr,"sudoku: error: can't create the trace '%s'.\n",
+              trace_path);
+      exit(EXIT_FAILURE);
+    }
+  }
 
-    if (temp>=2) {
-      printf("The grid has been solved. There is >%d solutions\n", temp);
-    } else if (temp==1) {
-      printf("The grid has been solved. There is only one solution\n");
+  budget_init(&budget, timeout_ms, max_nodes);
+  if (!generate) {
+    if (checkpoint_path != NULL) {
+      checkpoint_signals();
     } else {
-      printf("The grid isn't consistant.\n");
+      signal(SIGINT, interrupt_handler);
+    }
+
+    if (verify) {
+      status = (verify_batch() == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+    } else if (rate) {
+      rate_batch();
+    } else if (interactive) {
+      session_loop();
+    } else if (batch) {
+      solve_batch();
+    } else if (resume_path != NULL) {
+      load_checkpoint();
+      solve_grid(0);
+      grid_free(grid);
+    } else {
+      grid_read(pFILEinput, false);
+      solve_grid(0);
+      grid_free(grid);
     }
-    
-    grid_print(grid);
-    grid_free(grid);
 
     close_and_check(pFILEinput);
 
   } else {
-    generate_grid();
-    grid_print(grid);
-    grid_free(grid);
+    signal(SIGINT, interrupt_handler);
+    generate_batch((count && count_limit > 0) ? count_limit : 1);
+  }
+  budget_free(&budget);
+
+  if (metrics != NULL) {
+    metrics_summary(metrics, stderr);
+    metrics_free(metrics);
+  }
+  if (trace != NULL) {
+    uint64_t dropped = trace->dropped;
+    if (!trace_free(trace)) {
+      fprintf(stderr,"sudoku: error: can't write the trace '%s'.\n",
+              trace_path);
+      status = EXIT_FAILURE;
+    } else if (dropped > 0) {
+      fprintf(stderr,"sudoku: warning: %llu events couldn't be traced, "
+                     "try a larger -x.\n", (unsigned long long) dropped);
+    }
   }
 
   /*warning : the standard output may close there.*/
   close_and_check(pFILEoutput);
-  return 0;
+  return status;
 }
 
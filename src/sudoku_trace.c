@@ -0,0 +1,161 @@
+#include "sudoku.h"
+
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <trace.h>
+
+/* number of events read from the file at once */
+#define CHUNK_EVENTS 4096
+
+static bool summary;
+
+
+static void usage (int status)
+{
+  if (status == EXIT_SUCCESS) {
+    printf(
+      "Usage: sudoku-trace [OPTIONS] FILE\n"
+      "Decode a trace written by sudoku --trace.\n\n"
+      "-s,\t --summary\t\tonly count the events\n"
+      "-V,\t --version\t\tdisplay version and exit\n"
+      "-h,\t --help\t\t\tdisplay this help\n\n");
+    exit(EXIT_SUCCESS);
+  }
+  fprintf(stderr, "try 'sudoku-trace --help' for more information.\n");
+  exit(EXIT_FAILURE);
+}
+
+
+static void event_print (const trace_event_t *event, uint64_t node, int size)
+{
+  printf("%llu\t%u\t%s\t%s\t", (unsigned long long) node, event->depth,
+         trace_kind_name(event->kind), trace_rule_name(event->rule));
+  if (event->cell >= 0 && size > 0) {
+    printf("%d,%d\t", event->cell / size, event->cell % size);
+  } else {
+    printf("-\t");
+  }
+  if (event->color >= 0) {
+    printf("%d\t", event->color + 1);
+  } else {
+    printf("-\t");
+  }
+  printf("%u\n", event->left);
+}
+
+
+int main (int argc, char *argv[])
+{
+  struct option long_opts[] = {
+    {"summary",	0, NULL, 's'},
+    {"version",	0, NULL, 'V'},
+    {"help",	0, NULL, 'h'},
+    {NULL,	0, NULL, 0  }
+  };
+  int optc;
+
+  while ((optc = getopt_long(argc, argv, "sVh", long_opts, NULL)) != -1) {
+    switch (optc) {
+      case 's' :
+        summary = true;
+        break;
+      case 'V' :
+        printf("%s v%i.%i.%i\n", argv[0], PROG_VERSION, PROG_SUBVERSION,
+               PROG_REVISION);
+        exit(EXIT_SUCCESS);
+      case 'h' :
+        usage(EXIT_SUCCESS);
+        break;
+      default :
+        usage(EXIT_FAILURE);
+    }
+  }
+  if (optind + 1 != argc) {
+    fprintf(stderr, "sudoku-trace: error: one trace file is needed.\n");
+    usage(EXIT_FAILURE);
+  }
+
+  FILE *file = fopen(argv[optind], "rb");
+  trace_header_t header;
+  if (file == NULL) {
+    fprintf(stderr, "sudoku-trace: error: can't open '%s'.\n", argv[optind]);
+    exit(EXIT_FAILURE);
+  }
+  if (fread(&header, sizeof(header), 1, file) != 1 ||
+      memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != TRACE_VERSION ||
+      header.event_size != sizeof(trace_event_t)) {
+    fprintf(stderr, "sudoku-trace: error: '%s' isn't a trace.\n",
+            argv[optind]);
+    exit(EXIT_FAILURE);
+  }
+
+  trace_event_t events[CHUNK_EVENTS];
+  uint64_t kinds[TRACE_KINDS] = {0};
+  uint64_t changes[TRACE_RULES] = {0};
+  uint64_t read = 0;
+  uint64_t node = 0;
+  unsigned max_depth = 0;
+  int size = 0;
+  size_t n;
+
+  if (!summary) {
+    printf("# node\tdepth\tevent\trule\tcell\tcolor\tleft\n");
+  }
+  while ((n = fread(events, sizeof(trace_event_t), CHUNK_EVENTS, file)) > 0) {
+    for (size_t k = 0; k<n; k++) {
+      const trace_event_t *event = &events[k];
+
+      /* nodes are written modulo 2^32 and only grow */
+      if (event->node < (uint32_t) node) {
+        node += (uint64_t) 1 << 32;
+      }
+      node = (node & ~(uint64_t) UINT32_MAX) | event->node;
+
+      if (event->kind == TRACE_GRID) {
+        size = event->left;
+      }
+      if (event->kind < TRACE_KINDS) {
+        kinds[event->kind]++;
+      }
+      if ((event->kind == TRACE_ASSIGN || event->kind == TRACE_ELIMINATE) &&
+          event->rule < TRACE_RULES) {
+        changes[event->rule]++;
+      }
+      if (event->depth > max_depth) {
+        max_depth = event->depth;
+      }
+      if (!summary) {
+        event_print(event, node, size);
+      }
+    }
+    read += n;
+  }
+  fclose(file);
+
+  if (summary) {
+    printf("events\t%llu\ndropped\t%llu\nnodes\t%llu\nmax depth\t%u\n",
+           (unsigned long long) read, (unsigned long long) header.dropped,
+           (unsigned long long) header.nodes, max_depth);
+    for (int kind = 0; kind<TRACE_KINDS; kind++) {
+      printf("%s\t%llu\n", trace_kind_name(kind),
+             (unsigned long long) kinds[kind]);
+    }
+    for (int rule = 0; rule<TRACE_RULES; rule++) {
+      if (changes[rule] > 0) {
+        printf("changes by %s\t%llu\n", trace_rule_name(rule),
+               (unsigned long long) changes[rule]);
+      }
+    }
+  }
+  if (read != header.events) {
+    fprintf(stderr, "sudoku-trace: warning: %llu events announced, %llu "
+                    "read.\n", (unsigned long long) header.events,
+            (unsigned long long) read);
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,185 @@
+#include <trace.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* the ring has one writer on each side : the search moves head, the
+   writing thread moves tail, each one only reading the other's index */
+#ifdef __GNUC__
+#define LOAD(x) __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+#define STORE(x, value) __atomic_store_n(&(x), (value), __ATOMIC_RELEASE)
+#else
+#define LOAD(x) (x)
+#define STORE(x, value) ((x) = (value))
+#endif
+
+#define RING_MASK (TRACE_RING_EVENTS - 1)
+
+static const char *kind_names[TRACE_KINDS] = {
+  "grid", "branch", "assign", "eliminate", "contradiction", "backtrack",
+  "solution", "clue-removed", "clue-kept"
+};
+
+static const char *rule_names[TRACE_RULES] = {
+  "-", "given", "choice", "cross-hatching", "lone-number"
+};
+
+
+static void write_header (trace_t *trace, uint64_t events)
+{
+  trace_header_t header;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+  header.version = TRACE_VERSION;
+  header.event_size = sizeof(trace_event_t);
+  header.events = events;
+  header.dropped = trace->dropped;
+  header.nodes = trace->nodes;
+  if (fwrite(&header, sizeof(header), 1, trace->file) != 1) {
+    trace->failed = true;
+  }
+}
+
+
+/* write the events of the ring as they come, until the search stops */
+static void *writer_main (void *data)
+{
+  trace_t *trace = data;
+  struct timespec pause = {0, 1000000};
+
+  for (;;) {
+    bool stop = LOAD(trace->stop);
+    uint64_t head = LOAD(trace->head);
+    uint64_t tail = trace->tail;
+
+    if (head == tail) {
+      if (stop) {
+        return NULL;
+      }
+      nanosleep(&pause, NULL);
+      continue;
+    }
+
+    /* up to the end of the ring, the rest on the next turn */
+    size_t first = tail & RING_MASK;
+    size_t count = head - tail;
+    if (first + count > TRACE_RING_EVENTS) {
+      count = TRACE_RING_EVENTS - first;
+    }
+    if (fwrite(trace->ring + first, sizeof(trace_event_t), count,
+               trace->file) != count) {
+      trace->failed = true;
+    }
+    STORE(trace->tail, tail + count);
+  }
+}
+
+
+trace_t *trace_new (const char *path, uint64_t sample)
+{
+  trace_t *trace = calloc(1, sizeof(trace_t));
+  if (trace == NULL) {
+    return NULL;
+  }
+  trace->ring = malloc(TRACE_RING_EVENTS * sizeof(trace_event_t));
+  trace->file = fopen(path, "wb");
+  if (trace->ring == NULL || trace->file == NULL) {
+    if (trace->file != NULL) {
+      fclose(trace->file);
+    }
+    free(trace->ring);
+    free(trace);
+    return NULL;
+  }
+
+  trace->sample = (sample < 1) ? 1 : sample;
+  trace->countdown = 1;
+  /* what happens before the first node (loading a grid) is traced */
+  trace->sampled = true;
+  write_header(trace, 0);
+  if (pthread_create(&trace->writer, NULL, writer_main, trace) != 0) {
+    fclose(trace->file);
+    free(trace->ring);
+    free(trace);
+    return NULL;
+  }
+  return trace;
+}
+
+
+void trace_node (trace_t *trace)
+{
+  trace->nodes++;
+  trace->countdown--;
+  trace->sampled = (trace->countdown == 0);
+  if (trace->sampled) {
+    trace->countdown = trace->sample;
+  }
+}
+
+
+void trace_event (trace_t *trace, int kind, int rule, int depth, int cell,
+                  int color, int left)
+{
+  uint64_t head = trace->head;
+
+  if (head - LOAD(trace->tail) == TRACE_RING_EVENTS) {
+    trace->dropped++;
+    return;
+  }
+
+  trace_event_t *event = &trace->ring[head & RING_MASK];
+  event->node = (uint32_t) trace->nodes;
+  event->cell = cell;
+  event->depth = depth;
+  event->kind = kind;
+  event->rule = rule;
+  event->color = color;
+  event->left = left;
+  STORE(trace->head, head + 1);
+}
+
+
+void trace_change (trace_t *trace, int rule, int depth, int cell,
+                   pset_t old, pset_t new)
+{
+  if (pset_is_empty(new)) {
+    trace_event(trace, TRACE_CONTRADICTION, rule, depth, cell, -1, 0);
+  } else if (pset_is_singleton(new)) {
+    trace_event(trace, TRACE_ASSIGN, rule, depth, cell, pset_index(new), 1);
+  } else {
+    pset_t removed = pset_leftmost(pset_discard2(old, new));
+    trace_event(trace, TRACE_ELIMINATE, rule, depth, cell,
+                pset_index(removed), pset_cardinality(new));
+  }
+}
+
+
+bool trace_free (trace_t *trace)
+{
+  STORE(trace->stop, true);
+  pthread_join(trace->writer, NULL);
+
+  /* the events written are the ones which went through the ring */
+  rewind(trace->file);
+  write_header(trace, trace->head);
+  bool written = !trace->failed && fclose(trace->file) == 0;
+
+  free(trace->ring);
+  free(trace);
+  return written;
+}
+
+
+const char *trace_kind_name (int kind)
+{
+  return (kind >= 0 && kind < TRACE_KINDS) ? kind_names[kind] : "?";
+}
+
+
+const char *trace_rule_name (int rule)
+{
+  return (rule >= 0 && rule < TRACE_RULES) ? rule_names[rule] : "?";
+}
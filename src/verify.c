@@ -0,0 +1,144 @@
+#include <verify.h>
+
+#include <stddef.h>
+
+
+static int block_of (int size)
+{
+  int block = 1;
+  while ((block + 1) * (block + 1) <= size) {
+    block++;
+  }
+  return block;
+}
+
+
+/* The check of every grid, without a branch depending on the cells : the
+   colors of each unit are ORed together over contiguous arrays (which the
+   compiler turns into vector instructions), and the results are only looked
+   at once the whole grid has been read. With no empty cell and as many
+   colors as cells, every cell is a singleton, so a unit holding all the
+   colors has each of them once. */
+static bool grid_is_valid (int size, const pset_t *cells,
+                           const pset_t *givens)
+{
+  int block = block_of(size);
+  pset_t full = pset_full(size);
+  pset_t lines[MAX_COLORS];
+  pset_t rows[MAX_COLORS];
+  pset_t blocks[MAX_COLORS];
+  int stack[MAX_COLORS];
+  pset_t outside = pset_empty();
+  size_t colors = 0;
+  int empty = 0;
+
+  for (int i = 0; i<size; i++) {
+    lines[i] = rows[i] = blocks[i] = pset_empty();
+    stack[i] = i / block;
+  }
+
+  for (int j = 0; j<size; j++) {
+    const pset_t *line = cells + j * size;
+    pset_t *band = blocks + (j / block) * block;
+    pset_t all = pset_empty();
+
+    for (int i = 0; i<size; i++) {
+      all = pset_or(all, line[i]);
+      rows[i] = pset_or(rows[i], line[i]);
+      band[stack[i]] = pset_or(band[stack[i]], line[i]);
+      colors += pset_cardinality(line[i]);
+      empty |= pset_is_empty(line[i]);
+    }
+    if (givens != NULL) {
+      for (int i = 0; i<size; i++) {
+        outside = pset_or(outside,
+                          pset_discard2(line[i], givens[j * size + i]));
+      }
+    }
+    lines[j] = all;
+  }
+
+  int valid = (colors == (size_t) size * size) & !empty &
+              pset_is_empty(outside);
+  for (int k = 0; k<size; k++) {
+    valid &= pset_equal(lines[k], full) & pset_equal(rows[k], full) &
+             pset_equal(blocks[k], full);
+  }
+  return valid;
+}
+
+
+/* the first color seen twice in the unit made of the cells
+   first, first + step, ... (block lines being size apart) */
+static bool unit_duplicate (int size, int block, const pset_t *cells,
+                            int kind, int unit, verify_error_t *error)
+{
+  pset_t seen = pset_empty();
+
+  for (int k = 0; k<size; k++) {
+    int cell;
+    if (kind == VERIFY_LINE) {
+      cell = unit * size + k;
+    } else if (kind == VERIFY_ROW) {
+      cell = k * size + unit;
+    } else {
+      cell = ((unit / block) * block + k / block) * size +
+             (unit % block) * block + k % block;
+    }
+
+    pset_t twice = pset_and(cells[cell], seen);
+    if (!pset_is_empty(twice)) {
+      error->kind = kind;
+      error->unit = unit;
+      error->cell = cell;
+      error->color = pset_leftmost(twice);
+      return true;
+    }
+    seen = pset_or(seen, cells[cell]);
+  }
+  return false;
+}
+
+
+/* only for the wrong grids : look for the violation cell by cell, then
+   unit by unit */
+static void first_violation (int size, const pset_t *cells,
+                             const pset_t *givens, verify_error_t *error)
+{
+  int block = block_of(size);
+
+  error->kind = VERIFY_OK;
+  for (int c = 0; c<size * size; c++) {
+    error->cell = c;
+    error->unit = c / size;
+    if (!pset_is_singleton(cells[c])) {
+      error->kind = VERIFY_CELL;
+      error->color = cells[c];
+      return;
+    }
+    if (givens != NULL && !pset_is_included(cells[c], givens[c])) {
+      error->kind = VERIFY_GIVEN;
+      error->color = givens[c];
+      return;
+    }
+  }
+
+  for (int kind = VERIFY_LINE; kind<=VERIFY_BLOCK; kind++) {
+    for (int unit = 0; unit<size; unit++) {
+      if (unit_duplicate(size, block, cells, kind, unit, error)) {
+        return;
+      }
+    }
+  }
+}
+
+
+bool verify_grid (int size, const pset_t *cells, const pset_t *givens,
+                  verify_error_t *error)
+{
+  if (grid_is_valid(size, cells, givens)) {
+    return true;
+  }
+  first_violation(size, cells, givens, error);
+  return false;
+}
@@ -0,0 +1,128 @@
+#!/bin/sh
+# Checks of the sudoku executable, run by 'make check' from the top
+# directory. Each check prints its name, and the script exits with 1 if one
+# of them failed.
+
+cd "$(dirname "$0")" || exit 1
+SUDOKU=../src/sudoku
+GRIDS=grids
+TMP=$(mktemp -d) || exit 1
+trap 'rm -rf "$TMP"' EXIT
+failed=0
+
+
+pass ()
+{
+  echo "ok      $1"
+}
+
+
+fail ()
+{
+  echo "FAILED  $*"
+  failed=1
+}
+
+
+# the last line of a count : "There are exactly N solutions"
+count ()
+{
+  "$SUDOKU" "$@" | tail -n 1
+}
+
+
+# the bitboards and the scalar propagation find the same solutions
+for grid in many9 many16 unique9; do
+  for jobs in 1 2; do
+    expected=$(count -c -j $jobs "$GRIDS/$grid.txt")
+    scalar=$(count -S -c -j $jobs "$GRIDS/$grid.txt")
+    if [ -n "$expected" ] && [ "$expected" = "$scalar" ]; then
+      pass "bitboards and scalar counts of $grid with $jobs jobs"
+    else
+      fail "bitboards and scalar counts of $grid with $jobs jobs" \
+           "('$expected', '$scalar')"
+    fi
+  done
+done
+
+
+# a count stopped and resumed from its checkpoint finds every solution
+expected=$(count -c "$GRIDS/many9.txt")
+"$SUDOKU" -c -n 5000 -K "$TMP/count.ck" "$GRIDS/many9.txt" >/dev/null 2>&1
+resumed=$(count -R "$TMP/count.ck" 2>/dev/null)
+if [ -n "$expected" ] && [ "$expected" = "$resumed" ]; then
+  pass "resumed count"
+else
+  fail "resumed count" "('$expected', '$resumed')"
+fi
+
+# a checkpoint of a size which isn't a square is rejected, not resumed
+for size in 2 5 10; do
+  sed "s/^engine 9$/engine $size/" "$TMP/count.ck" > "$TMP/bad.ck"
+  "$SUDOKU" -R "$TMP/bad.ck" >/dev/null 2>"$TMP/bad.err"
+  status=$?
+  if [ $status -eq 1 ] && grep -q "isn't a checkpoint" "$TMP/bad.err"; then
+    pass "checkpoint of size $size rejected"
+  else
+    fail "checkpoint of size $size rejected" "(exit status $status)"
+  fi
+done
+
+
+# -Y checks each solved grid on its own, -y would pair them
+if "$SUDOKU" -Y "$GRIDS/solved9.txt" 2>&1 | grep -q "3 valid, 0 wrong"; then
+  pass "solved grids without puzzles"
+else
+  fail "solved grids without puzzles"
+fi
+
+# grid 1 with two cells swapped in its first line, grid 2 with a blank
+awk 'NR == 11 { t = $1; $1 = $2; $2 = t } NR == 21 { $5 = "_" } { print }' \
+    "$GRIDS/solved9.txt" > "$TMP/wrong9.txt"
+"$SUDOKU" -Y "$TMP/wrong9.txt" > "$TMP/wrong.out" 2>/dev/null
+status=$?
+if [ $status -eq 1 ] && [ "$(grep -c '^grid' "$TMP/wrong.out")" -eq 2 ] &&
+   grep -q "^grid 1: row" "$TMP/wrong.out" &&
+   grep -q "^grid 2: the cell at line 0, row 4" "$TMP/wrong.out"; then
+  pass "wrong solved grids reported"
+else
+  fail "wrong solved grids reported" "(exit status $status)"
+fi
+
+
+# removing an early given after many edits leaves the candidates of a session
+# loaded with the givens left
+"$SUDOKU" "$GRIDS/unique9.txt" | grep . | tail -n 9 > "$TMP/solution9.txt"
+awk '{ for (row = 1; row <= NF; row++) printf "_\t"; printf "\n" }' \
+    "$TMP/solution9.txt" > "$TMP/empty9.txt"
+# every fifth cell of the solution, the last one placed first
+awk '{ for (row = 1; row <= NF; row++)
+         if ((9 * (NR - 1) + row - 1) % 5 == 0) print NR - 1, row - 1, $row }' \
+    "$TMP/solution9.txt" | sort -k1,1nr -k2,2nr > "$TMP/placed.txt"
+{
+  echo "place 0 1 3"
+  sed 's/^/place /' "$TMP/placed.txt"
+  echo "remove 0 1"
+  echo "remove 6 6"; echo "undo"
+  echo "place 7 7 1"; echo "undo"
+  echo "remove 3 8"
+  echo "remove 8 8"
+  echo "print"
+} > "$TMP/edits.txt"
+awk 'FNR == NR { if ($1 $2 != "38" && $1 $2 != "88") given[$1 " " $2] = $3
+                 next }
+     { for (row = 1; row <= NF; row++) {
+         key = (FNR - 1) " " (row - 1)
+         printf "%s\t", (key in given) ? given[key] : "_" }
+       printf "\n" }' \
+    "$TMP/placed.txt" "$TMP/solution9.txt" > "$TMP/left9.txt"
+edited=$("$SUDOKU" -u "$TMP/empty9.txt" < "$TMP/edits.txt" | grep . | tail -n 9)
+fresh=$(echo print | "$SUDOKU" -u "$TMP/left9.txt")
+if [ -n "$fresh" ] && [ "$edited" = "$fresh" ]; then
+  pass "session candidates after removing an early given"
+else
+  fail "session candidates after removing an early given"
+fi
+
+
+exit $failed